@@ -0,0 +1,41 @@
+#!/usr/bin/python3
+
+# generates a large translation unit (at least argv[1] bytes) for benchmarks
+
+import sys
+
+TEMPLATE = """
+int counter_{i};
+int table_{i}[16];
+
+/* synthetic function #{i} */
+int func_{i}(int a, int b) {{
+  int s = 0;
+  int k;
+  for (k = 0; k < 16; ++k) {{
+    if (k % 3 == 0 && b != {i}) {{
+      s = s + k * a;  // accumulate
+    }} else {{
+      s = s - (b + {i}) / 2;
+    }}
+    table_{i}[k] = s;
+  }}
+  counter_{i} = counter_{i} + 1;
+  return s;
+}}
+"""
+
+size = int(sys.argv[1]) if len(sys.argv) > 1 else 8 * 1024 * 1024
+written = 0
+i = 0
+while written < size:
+    s = TEMPLATE.format(i=i)
+    sys.stdout.write(s)
+    written += len(s)
+    i += 1
+sys.stdout.write("""
+int main() {{
+  printf("%d\\n", func_{i}(1, 2));
+  return func_{i}(1, 2) % 256;
+}}
+""".format(i=i - 1))
@@ -15,15 +15,131 @@ void assert(int cond) {
   return;
 }
 
-int last_loop_label_index = 0;
-int label_index = 0;
+// bump allocators. program_arena holds what lives for the whole translation
+// unit (types, struct tags, globals, identifier names). function_arena holds
+// the AST, locals, declarations and string literals of the current top-level
+// declaration and is reset after it has been generated; its blocks are
+// reused.
+#define ARENA_BLOCK_SIZE 65536
+
+struct arena_block_t {
+  struct arena_block_t *next;
+  char *data;
+  int size;
+};
+typedef struct arena_block_t arena_block_t;
 
-int gen_loop_label_index() {
-  last_loop_label_index = label_index;
-  ++label_index;
-  return last_loop_label_index;
+struct arena_t {
+  char *name;
+  arena_block_t *first;
+  arena_block_t *current;
+  int used;  // bytes used in current
+
+  // statistics for --mem-report
+  size_t live;  // bytes allocated since the last reset
+  size_t peak;  // max of live
+  size_t total;
+  size_t reserved;
+  int allocations;
+  int resets;
+};
+typedef struct arena_t arena_t;
+
+arena_t *program_arena;
+arena_t *function_arena;
+
+arena_t *new_arena(char *name) {
+  arena_t *arena = calloc(1, sizeof(arena_t));
+  arena->name = name;
+  return arena;
+}
+
+void init_arenas() {
+  program_arena = new_arena("program");
+  function_arena = new_arena("function");
+}
+
+arena_block_t *new_arena_block(arena_t *arena, int size) {
+  arena_block_t *block = calloc(1, sizeof(arena_block_t));
+  block->data = malloc(size);
+  if (!block->data) {
+    error("out of memory");
+  }
+  block->size = size;
+  arena->reserved = arena->reserved + size;
+  return block;
+}
+
+// returns `size` zeroed bytes
+void *arena_alloc(arena_t *arena, int size) {
+  char *p;
+  arena_block_t *block;
+  size = (size + 7) / 8 * 8;
+  if (!arena->current || arena->current->size < arena->used + size) {
+    // move on to the next block that fits, or append a new one
+    block = arena->current;
+    if (block) {
+      block = block->next;
+    } else {
+      block = arena->first;
+    }
+    while (block && block->size < size) {
+      block = block->next;
+    }
+    if (!block) {
+      if (ARENA_BLOCK_SIZE < size) {
+        block = new_arena_block(arena, size);
+      } else {
+        block = new_arena_block(arena, ARENA_BLOCK_SIZE);
+      }
+      if (arena->current) {
+        block->next = arena->current->next;
+        arena->current->next = block;
+      } else {
+        block->next = arena->first;
+        arena->first = block;
+      }
+    }
+    arena->current = block;
+    arena->used = 0;
+  }
+  p = arena->current->data + arena->used;
+  arena->used = arena->used + size;
+  memset(p, 0, size);
+
+  ++arena->allocations;
+  arena->total = arena->total + size;
+  arena->live = arena->live + size;
+  if (arena->peak < arena->live) {
+    arena->peak = arena->live;
+  }
+  return p;
 }
 
+// copies old_size bytes of `old` to a new, larger allocation
+void *arena_grow(arena_t *arena, void *old, int old_size, int new_size) {
+  char *p = arena_alloc(arena, new_size);
+  if (old_size) {
+    memcpy(p, old, old_size);
+  }
+  return p;
+}
+
+void arena_reset(arena_t *arena) {
+  arena->current = NULL;
+  arena->used = 0;
+  arena->live = 0;
+  ++arena->resets;
+}
+
+void print_arena_report(arena_t *arena) {
+  eprintf("arena %s: %d allocations, %zd bytes, peak %zd bytes, ",
+          arena->name, arena->allocations, arena->total, arena->peak);
+  eprintf("%zd bytes reserved, %d resets\n", arena->reserved, arena->resets);
+}
+
+int label_index = 0;
+
 int gen_label_index() {
   int old_label_index = label_index;
   ++label_index;
@@ -51,389 +167,740 @@ const token_kind_t TK_TYPEDEF = 15;
 const token_kind_t TK_STRUCT = 16;
 const token_kind_t TK_SIZEOF = 17;
 const token_kind_t TK_EOF = 18;
+const token_kind_t TK_CONST = 19;
+const token_kind_t TK_STATIC = 20;
+const token_kind_t TK_INLINE = 21;
 
 struct token_t {
   token_kind_t kind;
-  struct token_t *next;
-  char *str;
-  size_t len;  // TK_RESERVED length
-  int num;
+  int offset;  // from the beginning of the source
+  int len;
 };
 
 typedef struct token_t token_t;
 
-token_t *token;
+// tokens are lexed on demand into a ring of TOKEN_WINDOW entries. positions
+// are counted from the beginning of the input; the parser may only look at
+// the last TOKEN_WINDOW tokens. literal values of TK_INT are kept in a side
+// table indexed like tokens.
+#define TOKEN_WINDOW 1024
 
-bool consume(char *op) {
-  if (token->kind != TK_RESERVED || strlen(op) != token->len ||
-      memcmp(token->str, op, token->len)) {
+char *source;
+int lex_pos = 0;  // offset of the next byte to lex
+token_t *tokens;
+int *token_values;
+int token_count = 0;  // tokens lexed so far
+
+int token_pos = 0;  // parser cursor
+
+void lex_token();
+
+char *token_str(token_t *tok) { return source + tok->offset; }
+
+int token_slot(int pos) { return pos & (TOKEN_WINDOW - 1); }
+
+token_t *token_at(int pos) {
+  while (token_count <= pos) {
+    lex_token();
+  }
+  if (pos + TOKEN_WINDOW < token_count) {
+    error("token %d has left the lookahead window", pos);
+  }
+  return tokens + token_slot(pos);
+}
+
+int token_value(int pos) {
+  token_at(pos);
+  return token_values[token_slot(pos)];
+}
+
+token_t *cur_token() { return token_at(token_pos); }
+
+bool equal_reserved(token_t *tok, char *op) {
+  // reserved tokens are 1 or 2 characters long
+  if (tok->kind != TK_RESERVED || source[tok->offset] != op[0]) {
     return 0;
   }
-  token = token->next;
-  return 1;
+  if (tok->len == 1) {
+    return op[1] == '\0';
+  }
+  return source[tok->offset + 1] == op[1] && op[2] == '\0';
 }
 
-bool peek(char *op) {
-  if (token->kind != TK_RESERVED || strlen(op) != token->len ||
-      memcmp(token->str, op, token->len)) {
+bool consume(char *op) {
+  if (!equal_reserved(cur_token(), op)) {
     return 0;
   }
+  ++token_pos;
   return 1;
 }
 
-bool is_int() { return token->kind == TK_INT; }
+bool peek(char *op) { return equal_reserved(cur_token(), op); }
+
+bool is_int() {
+  token_t *tok = cur_token();
+  return tok->kind == TK_INT;
+}
 
 void expect(char *op) {
-  if (token->kind != TK_RESERVED || strlen(op) != token->len ||
-      memcmp(token->str, op, token->len)) {
-    error("not '%s', got '%s'\n", op, token->str);
+  token_t *tok = cur_token();
+  if (!equal_reserved(tok, op)) {
+    error("not '%s', got '%.*s'\n", op, tok->len, token_str(tok));
   }
-  token = token->next;
+  ++token_pos;
 }
 
 int expect_int() {
-  if (token->kind != TK_INT) {
-    char *s = calloc(token->len + 1, sizeof(char));
-    memcpy(s, token->str, token->len);
-    error("'%s' is not int\n", s);
+  token_t *tok = cur_token();
+  if (tok->kind != TK_INT) {
+    error("'%.*s' is not int\n", tok->len, token_str(tok));
   }
-  int val = token->num;
-  token = token->next;
-  return val;
+  ++token_pos;
+  return token_value(token_pos - 1);
 }
 
-token_t *consume_ident() {
-  if (token->kind != TK_IDENT) {
-    char *s = calloc(token->len + 1, sizeof(char));
-    memcpy(s, token->str, token->len);
-    error("'%s' is not ident\n", s);
+// returns the identifier id
+int consume_ident() {
+  token_t *tok = cur_token();
+  if (tok->kind != TK_IDENT) {
+    error("'%.*s' is not ident\n", tok->len, token_str(tok));
   }
-  token_t *tok = token;
-  token = token->next;
-  return tok;
+  ++token_pos;
+  return token_value(token_pos - 1);
 }
 
-token_t *peek_ident() {
-  if (token->kind != TK_IDENT) {
-    return NULL;
+// returns the identifier id, or 0 if the next token is not an identifier
+int peek_ident() {
+  token_t *tok = cur_token();
+  if (tok->kind != TK_IDENT) {
+    return 0;
   }
-  return token;
+  return token_value(token_pos);
 }
 
-token_t *consume_ident_or_fail() {
-  if (token->kind != TK_IDENT) {
-    return NULL;
+int consume_ident_or_fail() {
+  token_t *tok = cur_token();
+  if (tok->kind != TK_IDENT) {
+    return 0;
   }
-  token_t *tok = token;
-  token = token->next;
-  return tok;
+  ++token_pos;
+  return token_value(token_pos - 1);
 }
 
 token_t *consume_reserved(token_kind_t kind) {
-  if (token->kind != kind) {
+  token_t *tok = cur_token();
+  if (tok->kind != kind) {
     return NULL;
   }
-  token_t *tok = token;
-  token = token->next;
+  ++token_pos;
   return tok;
 }
 
 token_t *consume_any_type() {
-  if (token->kind == TK_TYPE_INT || token->kind == TK_TYPE_CHAR ||
-      token->kind == TK_TYPE_VOID) {
-    token_t *tok = token;
-    token = token->next;
+  token_t *tok = cur_token();
+  if (tok->kind == TK_TYPE_INT || tok->kind == TK_TYPE_CHAR ||
+      tok->kind == TK_TYPE_VOID) {
+    ++token_pos;
     return tok;
   }
   return NULL;
 }
 
-void push_token(token_t *tok) {
-  if (tok->next != token) {
+void push_token() {
+  if (token_pos == 0) {
     error("failed to push token");
   }
-  token = tok;
+  --token_pos;
 }
 
-bool at_eof() { return token->kind == TK_EOF; }
+bool at_eof() {
+  token_t *tok = cur_token();
+  return tok->kind == TK_EOF;
+}
 
-token_t *new_token(token_kind_t kind, token_t *cur, char *str, size_t len) {
-  token_t *tok = calloc(1, sizeof(token_t));
+// overwrites the oldest token of the window
+int new_token(token_kind_t kind, int offset, int len) {
+  token_t *tok = tokens + token_slot(token_count);
   tok->kind = kind;
-  tok->str = str;
+  tok->offset = offset;
   tok->len = len;
-  cur->next = tok;
-  return tok;
+  token_values[token_slot(token_count)] = 0;
+  ++token_count;
+  return token_count - 1;
+}
+
+// identifiers are interned while tokenizing: every distinct name gets a small
+// integer id (0 means "no name"), stored in token_values[] of its TK_IDENT
+// token. symbols of every namespace are bound on the identifier itself, so
+// resolving a name is an array access and comparing names is an int compare.
+struct ident_t {
+  char *str;
+  int len;
+  int hash;
+  struct global_variable_t *global;
+  struct local_variable_t *local;  // innermost visible one
+  struct type_t *alias;            // typedef
+  struct type_struct_t *struct_tag;
+  struct inline_body_t *inline_body;  // a function kept for inlining
+};
+typedef struct ident_t ident_t;
+
+ident_t *idents;
+int ident_count = 0;
+int ident_capacity = 0;
+int *ident_table;  // open addressing hash table of ids, 0 is empty
+int ident_table_size = 0;
+
+char *ident_str(int id) { return idents[id].str; }
+
+int ident_len(int id) { return idents[id].len; }
+
+void insert_ident_table(int id) {
+  int i = idents[id].hash & (ident_table_size - 1);
+  while (ident_table[i]) {
+    i = (i + 1) & (ident_table_size - 1);
+  }
+  ident_table[i] = id;
 }
 
-int compare_token(token_t *tok, char *str, size_t len) {
-  return tok->len == len && strncmp(tok->str, str, len) == 0;
+void init_idents() {
+  ident_capacity = 1024;
+  idents = calloc(ident_capacity, sizeof(ident_t));
+  ident_count = 1;  // id 0 is reserved
+  ident_table_size = 2048;
+  ident_table = calloc(ident_table_size, sizeof(int));
 }
 
-token_t *tokenize(char *p) {
-  token_t head;
-  token_t *cur = &head;
-  size_t str_len = 0;
-  char *q;
-  head.next = NULL;
+void grow_ident_table() {
+  int id;
+  free(ident_table);
+  ident_table_size = ident_table_size * 2;
+  ident_table = calloc(ident_table_size, sizeof(int));
+  for (id = 1; id < ident_count; ++id) {
+    insert_ident_table(id);
+  }
+}
 
-  while (*p) {
-    if (isspace(*p)) {
-      ++p;
-      continue;
+int new_ident(char *s, int len, int hash) {
+  char *str;
+  if (ident_count == ident_capacity) {
+    ident_capacity = ident_capacity * 2;
+    idents = realloc(idents, ident_capacity * sizeof(ident_t));
+  }
+  // names outlive the source text, which is released as it is consumed
+  str = arena_alloc(program_arena, len);
+  memcpy(str, s, len);
+  memset(idents + ident_count, 0, sizeof(ident_t));
+  idents[ident_count].str = str;
+  idents[ident_count].len = len;
+  idents[ident_count].hash = hash;
+  ++ident_count;
+  return ident_count - 1;
+}
+
+// `hash` is computed by the tokenizer while scanning the identifier
+int intern(char *s, int len, int hash) {
+  int i;
+  int id;
+  if (ident_table_size <= 2 * ident_count) {
+    grow_ident_table();
+  }
+  i = hash & (ident_table_size - 1);
+  while ((id = ident_table[i])) {
+    if (idents[id].hash == hash && idents[id].len == len &&
+        memcmp(idents[id].str, s, len) == 0) {
+      return id;
     }
+    i = (i + 1) & (ident_table_size - 1);
+  }
+  id = new_ident(s, len, hash);
+  ident_table[i] = id;
+  return id;
+}
 
-    if (strncmp(p, "//", 2) == 0) {
-      p = p + 2;
-      while (*p != '\n') {
-        ++p;
-      }
+// a name the compiler refers to itself, hashed as the tokenizer does
+int intern_name(char *s) {
+  int n = 1;
+  int hash = s[0];
+  while (s[n]) {
+    hash = (hash * 31 + s[n]) & 16777215;
+    ++n;
+  }
+  return intern(s, n, hash);
+}
+
+// character classes for the tokenizer, indexed by (unsigned) byte
+const int CC_SPACE = 1;
+const int CC_DIGIT = 2;
+const int CC_IDENT_HEAD = 4;  // first character of an identifier
+const int CC_IDENT = 8;       // following characters of an identifier
+const int CC_PUNCT = 16;      // single character operator
+
+int char_class[256];
+
+// keyword table, indexed by keyword_hash() (collision free, checked on init)
+#define KEYWORD_TABLE_SIZE 64
+char *keyword_str[KEYWORD_TABLE_SIZE];
+int keyword_len[KEYWORD_TABLE_SIZE];
+token_kind_t keyword_kind[KEYWORD_TABLE_SIZE];
+
+bool tokenizer_initialized = 0;
+
+int keyword_hash(char *s, int len) {
+  return (len + 7 * s[0] + s[1] + 3 * s[len - 1]) % KEYWORD_TABLE_SIZE;
+}
+
+void add_keyword(char *s, token_kind_t kind) {
+  int len = strlen(s);
+  int h = keyword_hash(s, len);
+  if (keyword_len[h]) {
+    error("keyword hash collision: '%s' and '%s'", s, keyword_str[h]);
+  }
+  keyword_str[h] = s;
+  keyword_len[h] = len;
+  keyword_kind[h] = kind;
+}
+
+token_kind_t find_keyword(char *s, int len) {
+  int h;
+  if (len < 2) {
+    return TK_IDENT;
+  }
+  h = keyword_hash(s, len);
+  if (keyword_len[h] == len && memcmp(keyword_str[h], s, len) == 0) {
+    return keyword_kind[h];
+  }
+  return TK_IDENT;
+}
+
+void add_char_class(char *s, int cc) {
+  int i;
+  for (i = 0; s[i]; ++i) {
+    char_class[s[i] & 255] = char_class[s[i] & 255] | cc;
+  }
+}
+
+void init_tokenizer() {
+  int c;
+  if (tokenizer_initialized) {
+    return;
+  }
+  tokenizer_initialized = 1;
+  init_idents();
+  tokens = calloc(TOKEN_WINDOW, sizeof(token_t));
+  token_values = calloc(TOKEN_WINDOW, sizeof(int));
+
+  add_char_class(" ", CC_SPACE);
+  for (c = 9; c <= 13; ++c) {
+    char_class[c] = CC_SPACE;  // \t \n \v \f \r
+  }
+  for (c = '0'; c <= '9'; ++c) {
+    char_class[c] = CC_DIGIT | CC_IDENT;
+  }
+  for (c = 'a'; c <= 'z'; ++c) {
+    char_class[c] = CC_IDENT_HEAD | CC_IDENT;
+  }
+  for (c = 'A'; c <= 'Z'; ++c) {
+    char_class[c] = CC_IDENT_HEAD | CC_IDENT;
+  }
+  add_char_class("_", CC_IDENT);
+  add_char_class("+-*/%><()[]=;{},&.|!^", CC_PUNCT);
+
+  add_keyword("return", TK_RETURN);
+  add_keyword("if", TK_IF);
+  add_keyword("else", TK_ELSE);
+  add_keyword("while", TK_WHILE);
+  add_keyword("for", TK_FOR);
+  add_keyword("break", TK_BREAK);
+  add_keyword("continue", TK_CONTINUE);
+  add_keyword("int", TK_TYPE_INT);
+  add_keyword("char", TK_TYPE_CHAR);
+  add_keyword("size_t", TK_TYPE_INT);
+  add_keyword("bool", TK_TYPE_INT);
+  add_keyword("void", TK_TYPE_VOID);
+  add_keyword("typedef", TK_TYPEDEF);
+  add_keyword("struct", TK_STRUCT);
+  add_keyword("sizeof", TK_SIZEOF);
+  add_keyword("NULL", TK_INT);
+  add_keyword("const", TK_CONST);
+  add_keyword("static", TK_STATIC);
+  add_keyword("inline", TK_INLINE);
+}
+
+// "==", "!=", "<=", ">=", "++", "--", "->", "||", "&&"
+bool is_two_char_op(char *p) {
+  if (p[1] == '=') {
+    return p[0] == '=' || p[0] == '!' || p[0] == '<' || p[0] == '>';
+  }
+  if (p[0] == p[1]) {
+    return p[0] == '+' || p[0] == '-' || p[0] == '|' || p[0] == '&';
+  }
+  return p[0] == '-' && p[1] == '>';
+}
+
+int skip_line(char *s, int pos) {
+  while (s[pos] && s[pos] != '\n') {
+    ++pos;
+  }
+  return pos;
+}
+
+int skip_block_comment(char *s, int pos) {
+  while (s[pos]) {
+    if (s[pos] == '*' && s[pos + 1] == '/') {
+      return pos + 2;
+    }
+    ++pos;
+  }
+  error("unclosed comment");
+  return pos;
+}
+
+int char_literal_value(char c) {
+  if (c == '0') {
+    return '\0';
+  } else if (c == 'a') {
+    return '\a';
+  } else if (c == 'b') {
+    return '\b';
+  } else if (c == 'f') {
+    return '\f';
+  } else if (c == 'n') {
+    return '\n';
+  } else if (c == 't') {
+    return '\t';
+  } else if (c == '\\') {
+    return '\\';
+  } else if (c == '\'') {
+    return '\'';
+  }
+  error("failed to tokenize at '%c'\n'\\?...", c);
+  return 0;
+}
+
+void init_lexer(char *src) {
+  init_tokenizer();
+  source = src;
+  lex_pos = 0;
+  token_count = 0;
+  token_pos = 0;
+}
+
+// lexes the next token at lex_pos. a single pass over the input: every byte
+// is looked at a bounded number of times, and at most 2 bytes ahead of the
+// current one. at the end of the input TK_EOF is appended.
+void lex_token() {
+  char *src = source;
+  int pos = lex_pos;
+  int start;
+  int cc;
+  int n;
+  int tok;
+  int hash;
+  token_kind_t kind;
+
+  while (src[pos]) {
+    cc = char_class[src[pos] & 255];
+    if (cc & CC_SPACE) {
+      ++pos;
       continue;
     }
 
-    if (strncmp(p, "/*", 2) == 0) {
-      char *q = strstr(p + 2, "*/");
-      if (!q) {
-        error("unclosed comment");
-      }
-      p = q + 2;
+    if (src[pos] == '/' && src[pos + 1] == '/') {
+      pos = skip_line(src, pos + 2);
       continue;
     }
 
-    // skip preprocessor
-    if (*p == '#') {
-      p = p + 1;
-      while (*p != '\n') {
-        ++p;
-      }
+    if (src[pos] == '/' && src[pos + 1] == '*') {
+      pos = skip_block_comment(src, pos + 2);
       continue;
     }
-    if (6 <= strlen(p) && strncmp(p, "const", 5) == 0 && isspace(p[5])) {
-      p = p + 5;
+
+    // skip preprocessor
+    if (src[pos] == '#') {
+      pos = skip_line(src, pos + 1);
       continue;
     }
 
-    if (2 <= strlen(p)) {
-      if (memcmp(p, "==", 2) == 0 || memcmp(p, "!=", 2) == 0 ||
-          memcmp(p, "<=", 2) == 0 || memcmp(p, ">=", 2) == 0 ||
-          memcmp(p, "++", 2) == 0 || memcmp(p, "--", 2) == 0 ||
-          memcmp(p, "->", 2) == 0 || memcmp(p, "||", 2) == 0 ||
-          memcmp(p, "&&", 2) == 0) {
-        cur = new_token(TK_RESERVED, cur, p, 2);
-        p = p + 2;
-        continue;
-      }
+    if (is_two_char_op(src + pos)) {
+      new_token(TK_RESERVED, pos, 2);
+      lex_pos = pos + 2;
+      return;
     }
-    if (*p == '+' || *p == '-' || *p == '*' || *p == '/' || *p == '%' ||
-        *p == '>' || *p == '<' || *p == '(' || *p == ')' || *p == '[' ||
-        *p == ']' || *p == '=' || *p == ';' || *p == '{' || *p == '}' ||
-        *p == ',' || *p == '&' || *p == '.' || *p == '|' || *p == '!' ||
-        *p == '^') {
-      cur = new_token(TK_RESERVED, cur, p, 1);
-      ++p;
-      continue;
+    if (cc & CC_PUNCT) {
+      new_token(TK_RESERVED, pos, 1);
+      lex_pos = pos + 1;
+      return;
     }
 
-    if (isalpha(*p)) {
-      int n = 1;
-      while (isalnum(*(p + n)) || *(p + n) == '_') {
+    if (cc & CC_IDENT_HEAD) {
+      n = 1;
+      hash = src[pos];
+      while (char_class[src[pos + n] & 255] & CC_IDENT) {
+        hash = (hash * 31 + src[pos + n]) & 16777215;
         ++n;
       }
-      cur = new_token(TK_IDENT, cur, p, n);
-      p = p + n;
-
-      if (compare_token(cur, "return", 6)) {
-        cur->kind = TK_RETURN;
-      } else if (compare_token(cur, "if", 2)) {
-        cur->kind = TK_IF;
-      } else if (compare_token(cur, "else", 4)) {
-        cur->kind = TK_ELSE;
-      } else if (compare_token(cur, "while", 5)) {
-        cur->kind = TK_WHILE;
-      } else if (compare_token(cur, "for", 3)) {
-        cur->kind = TK_FOR;
-      } else if (compare_token(cur, "break", 5)) {
-        cur->kind = TK_BREAK;
-      } else if (compare_token(cur, "continue", 8)) {
-        cur->kind = TK_CONTINUE;
-      } else if (compare_token(cur, "int", 3)) {
-        cur->kind = TK_TYPE_INT;
-      } else if (compare_token(cur, "char", 4)) {
-        cur->kind = TK_TYPE_CHAR;
-      } else if (compare_token(cur, "size_t", 6)) {
-        cur->kind = TK_TYPE_INT;
-      } else if (compare_token(cur, "bool", 4)) {
-        cur->kind = TK_TYPE_INT;
-      } else if (compare_token(cur, "void", 4)) {
-        cur->kind = TK_TYPE_VOID;
-      } else if (compare_token(cur, "typedef", 7)) {
-        cur->kind = TK_TYPEDEF;
-      } else if (compare_token(cur, "struct", 6)) {
-        cur->kind = TK_STRUCT;
-      } else if (compare_token(cur, "sizeof", 6)) {
-        cur->kind = TK_SIZEOF;
-      } else if (compare_token(cur, "NULL", 4)) {
-        cur->kind = TK_INT;
-        cur->num = 0;
+      kind = find_keyword(src + pos, n);
+      lex_pos = pos + n;
+      if (kind == TK_IDENT) {
+        tok = new_token(TK_IDENT, pos, n);
+        token_values[token_slot(tok)] = intern(src + pos, n, hash);
+        return;
       }
-
-      continue;
+      new_token(kind, pos, n);  // "NULL" is TK_INT, value = 0
+      return;
     }
 
-    if (isdigit(*p)) {
-      cur = new_token(TK_INT, cur, p, 0);
-      cur->num = strtol(p, &p, 10);
-      continue;
+    if (cc & CC_DIGIT) {
+      start = pos;
+      n = 0;
+      while (char_class[src[pos] & 255] & CC_DIGIT) {
+        n = n * 10 + src[pos] - '0';
+        ++pos;
+      }
+      tok = new_token(TK_INT, start, pos - start);
+      token_values[token_slot(tok)] = n;
+      lex_pos = pos;
+      return;
     }
 
-    if (*p == '\'') {
-      ++p;
-      if (*p == '\\') {
-        ++p;
-        cur = new_token(TK_INT, cur, p, 0);
-        if (*p == '0') {
-          cur->num = '\0';
-        } else if (*p == 'a') {
-          cur->num = '\a';
-        } else if (*p == 'b') {
-          cur->num = '\b';
-        } else if (*p == 'f') {
-          cur->num = '\f';
-        } else if (*p == 'n') {
-          cur->num = '\n';
-        } else if (*p == 't') {
-          cur->num = '\t';
-        } else if (*p == '\\') {
-          cur->num = '\\';
-        } else if (*p == '\'') {
-          cur->num = '\'';
-        } else {
-          error("failed to tokenize at '%c'\n'\\?...", *p);
-        }
+    if (src[pos] == '\'') {
+      start = pos;
+      ++pos;
+      if (src[pos] == '\\') {
+        ++pos;
+        n = char_literal_value(src[pos]);
       } else {
-        cur = new_token(TK_INT, cur, p, 0);
-        cur->num = *p;
+        n = src[pos];
       }
-      ++p;
-      if (*p != '\'') {
-        error("failed to tokenize at '%c'\n'x?...", *p);
+      ++pos;
+      if (src[pos] != '\'') {
+        error("failed to tokenize at '%c'\n'x?...", src[pos]);
       }
-      ++p;
-      continue;
+      ++pos;
+      tok = new_token(TK_INT, start, pos - start);
+      token_values[token_slot(tok)] = n;
+      lex_pos = pos;
+      return;
     }
 
-    if (*p == '"') {
-      q = p;
-      ++p;
-      str_len = 1;
-      while (*p != '"') {
-        if (*p == '\\') {
-          ++str_len;
-          ++p;
+    if (src[pos] == '"') {
+      start = pos;
+      ++pos;
+      while (src[pos] != '"') {
+        if (!src[pos]) {
+          error("unclosed string literal");
         }
-        ++str_len;
-        ++p;
+        if (src[pos] == '\\') {
+          ++pos;
+        }
+        ++pos;
       }
-      ++p;
-      ++str_len;  // includeing '"'s
-      cur = new_token(TK_STRING, cur, q, str_len);
-      continue;
+      ++pos;  // includeing '"'s
+      new_token(TK_STRING, start, pos - start);
+      lex_pos = pos;
+      return;
     }
 
-    error("failed to tokenize at '%c'\n", *p);
+    error("failed to tokenize at '%c'\n", src[pos]);
   }
 
-  new_token(TK_EOF, cur, p, 0);
-  return head.next;
+  new_token(TK_EOF, pos, 0);
+  lex_pos = pos;
 }
 
 typedef int type_kind_t;
 
-type_kind_t TYPE_INVALID = 0;
-type_kind_t TYPE_VOID = 1;
-type_kind_t TYPE_INT = 2;
-type_kind_t TYPE_CHAR = 3;
-type_kind_t TYPE_POINTER = 4;
-type_kind_t TYPE_ARRAY = 5;
-type_kind_t TYPE_FUNCTION = 6;
-type_kind_t TYPE_STRUCT = 7;
+const type_kind_t TYPE_INVALID = 0;
+const type_kind_t TYPE_VOID = 1;
+const type_kind_t TYPE_INT = 2;
+const type_kind_t TYPE_CHAR = 3;
+const type_kind_t TYPE_POINTER = 4;
+const type_kind_t TYPE_ARRAY = 5;
+const type_kind_t TYPE_FUNCTION = 6;
+const type_kind_t TYPE_STRUCT = 7;
 
-#define MAX_ARGS 8
 #define MAX_STRUCT_MEMBERS 32
 
 struct type_struct_t {
-  token_t *name;
+  int name;
+  bool defined;
   size_t member_count;
-  token_t *member_names[MAX_STRUCT_MEMBERS];
+  int member_names[MAX_STRUCT_MEMBERS];
   struct type_t *member_types[MAX_STRUCT_MEMBERS];
   size_t member_offsets[MAX_STRUCT_MEMBERS];
-  struct type_struct_t *next;
+  struct type_t *type;  // the canonical struct type
 };
 typedef struct type_struct_t type_struct_t;
 
-type_struct_t *type_struct = NULL;
+type_struct_t *find_type_struct(int name) { return idents[name].struct_tag; }
 
-type_struct_t *new_type_struct() { return calloc(1, sizeof(type_struct_t)); }
-
-type_struct_t *find_type_struct(token_t *name) {
-  type_struct_t *t = type_struct;
-  while (t) {
-    if (t->name->len == name->len &&
-        memcmp(t->name->str, name->str, name->len) == 0) {
-      return t;
-    }
-    t = t->next;
-  }
-  return NULL;
-}
-
-void add_type_struct(token_t *tok, type_struct_t *t) {
-  t->next = type_struct;
-  t->name = tok;
-  type_struct = t;
-}
-
-size_t get_member_index(type_struct_t *s, token_t *name) {
+size_t get_member_index(type_struct_t *s, int name) {
   size_t i;
   for (i = 0; i < s->member_count; ++i) {
-    if (s->member_names[i]->len == name->len &&
-        memcmp(s->member_names[i]->str, name->str, name->len) == 0) {
+    if (s->member_names[i] == name) {
       return i;
     }
   }
-  error("failed to get member offset at '%.*s'", name->len, name->str);
+  error("failed to get member offset at '%.*s'", ident_len(name),
+        ident_str(name));
   return 0;
 }
 
+// types are canonical: there is one void, int and char type, one struct type
+// per tag, and derived types are hash-consed, so types can be compared by
+// pointer. size and alignment are computed when a type is created (for
+// structs, when they are defined).
 struct type_t {
   type_kind_t ty;
-  struct type_t *ptr_to;
+  int id;  // creation order, for hashing
+  int size;
+  int align;
+  struct type_t *ptr_to;  // TYPE_POINTER, TYPE_ARRAY
   int n;  // for TYPE_ARRAY and TYPE_FUNCTION(# of parameters)
 
   // TYPE_FUNCTION
   struct type_t *ret;  // return type
-  struct type_t *args[MAX_ARGS];
-  token_t *arg_names[MAX_ARGS];
-  size_t arg_count;
+  struct type_t **args;
 
   // TYPE_STRUCT
   type_struct_t *struct_type;
 
-  token_t *name;  // for TEMPORAL TYPE
+  bool is_const;
+  struct type_t *const_type;  // the const qualified version, see const_of()
+
+  struct type_t *hash_next;  // in type_table
 };
 typedef struct type_t type_t;
 
-type_t *new_type() { return calloc(1, sizeof(type_t)); }
+#define TYPE_TABLE_SIZE 4096
+
+type_t *type_table[TYPE_TABLE_SIZE];
+int type_count;
+type_t *type_void;
+type_t *type_int;
+type_t *type_char;
+
+type_t *new_type(type_kind_t ty, int size, int align) {
+  type_t *t = arena_alloc(program_arena, sizeof(type_t));
+  t->ty = ty;
+  t->size = size;
+  t->align = align;
+  ++type_count;
+  t->id = type_count;
+  return t;
+}
+
+void init_types() {
+  type_void = new_type(TYPE_VOID, 1, 1);
+  type_int = new_type(TYPE_INT, 4, 4);
+  type_char = new_type(TYPE_CHAR, 1, 1);
+}
+
+int hash_type(int h, type_t *t) {
+  if (!t) {
+    return h;
+  }
+  return (h * 31 + t->id % TYPE_TABLE_SIZE) % TYPE_TABLE_SIZE;
+}
+
+// finds or creates the derived type. `ptr_to` is the element type of a
+// pointer or an array, `ret` the return type of a function.
+type_t *derived_type(type_kind_t ty, type_t *ptr_to, type_t *ret, int n,
+                     type_t **args) {
+  int h = ty;
+  int i;
+  type_t *t;
+  h = hash_type(h, ptr_to);
+  h = hash_type(h, ret);
+  h = (h * 31 + n % TYPE_TABLE_SIZE) % TYPE_TABLE_SIZE;
+  for (i = 0; i < n && args; ++i) {
+    h = hash_type(h, args[i]);
+  }
+
+  for (t = type_table[h]; t; t = t->hash_next) {
+    if (t->ty != ty || t->ptr_to != ptr_to || t->ret != ret || t->n != n) {
+      continue;
+    }
+    for (i = 0; i < n && args; ++i) {
+      if (t->args[i] != args[i]) {
+        break;
+      }
+    }
+    if (!args || i == n) {
+      return t;
+    }
+  }
 
-type_t *new_type_with(type_kind_t tk, type_t *ptr) {
-  type_t *t = calloc(1, sizeof(type_t));
-  t->ty = tk;
-  t->ptr_to = ptr;
+  if (ty == TYPE_ARRAY) {
+    t = new_type(ty, n * ptr_to->size, ptr_to->align);
+  } else {
+    t = new_type(ty, 4, 4);
+  }
+  t->ptr_to = ptr_to;
+  t->ret = ret;
+  t->n = n;
+  if (args) {
+    t->args = arena_alloc(program_arena, (n + 1) * sizeof(type_t *));
+    for (i = 0; i < n; ++i) {
+      t->args[i] = args[i];
+    }
+  }
+  t->hash_next = type_table[h];
+  type_table[h] = t;
   return t;
 }
 
+type_t *pointer_to(type_t *base) {
+  return derived_type(TYPE_POINTER, base, NULL, 0, NULL);
+}
+
+type_t *array_of(type_t *base, int n) {
+  return derived_type(TYPE_ARRAY, base, NULL, n, NULL);
+}
+
+type_t *function_type(type_t *ret, type_t **args, int n) {
+  return derived_type(TYPE_FUNCTION, NULL, ret, n, args);
+}
+
+// the const qualified version of a type. it is a copy that is canonical
+// like the type itself
+type_t *const_of(type_t *t) {
+  type_t *q;
+  if (t->is_const) {
+    return t;
+  }
+  if (!t->const_type) {
+    q = new_type(t->ty, t->size, t->align);
+    q->ptr_to = t->ptr_to;
+    q->n = t->n;
+    q->ret = t->ret;
+    q->args = t->args;
+    q->struct_type = t->struct_type;
+    q->is_const = 1;
+    t->const_type = q;
+  }
+  return t->const_type;
+}
+
+// the struct type for a tag, incomplete until its definition is parsed
+type_t *struct_type(int name) {
+  type_struct_t *s = find_type_struct(name);
+  if (!s) {
+    s = arena_alloc(program_arena, sizeof(type_struct_t));
+    s->name = name;
+    s->type = new_type(TYPE_STRUCT, 0, 4);
+    s->type->struct_type = s;
+    idents[name].struct_tag = s;
+  }
+  return s->type;
+}
+
 void print_type(type_t *t) {
   int i;
+  if (t->is_const) {
+    eprintf("const ");
+  }
   if (t->ty == TYPE_VOID) {
     eprintf("void");
   } else if (t->ty == TYPE_INT) {
@@ -464,252 +931,194 @@ void print_type(type_t *t) {
   }
 }
 
-size_t calc_size_of_type(type_t *t) {
-  if (t->ty == TYPE_INT) {
-    return 4;
-  } else if (t->ty == TYPE_CHAR) {
-    return 1;
-  } else if (t->ty == TYPE_POINTER) {
-    return 4;
-  } else if (t->ty == TYPE_ARRAY) {
-    return t->n * calc_size_of_type(t->ptr_to);
-  } else if (t->ty == TYPE_FUNCTION) {
-    return 4;
-  } else if (t->ty == TYPE_STRUCT) {
-    return t->struct_type->member_offsets[t->struct_type->member_count - 1] +
-           calc_size_of_type(
-               t->struct_type->member_types[t->struct_type->member_count - 1]);
-  }
-  error("calc_size_of_type: invalid data type: %d", t->ty);
-  return 0;
-}
+void add_type_alias(int name, type_t *type) { idents[name].alias = type; }
 
-size_t calc_size_of_struct(type_struct_t *s) {
-  return s->member_offsets[s->member_count - 1] +
-         calc_size_of_type(s->member_types[s->member_count - 1]);
-}
+type_t *find_type_alias(int name) { return idents[name].alias; }
 
-struct type_alias_t {
-  token_t *name;
-  struct type_t *type;
-  struct type_alias_t *next;
+struct type_and_name_t {
+  type_t *t;
+  int name;
+  int *arg_names;  // parameter names of a function declarator
 };
-typedef struct type_alias_t type_alias_t;
 
-type_alias_t *type_alias = NULL;
+typedef struct type_and_name_t type_and_name_t;
 
-void add_type_alias(token_t *name, type_t *type) {
-  type_alias_t *t = calloc(1, sizeof(type_alias_t));
-  t->name = name;
-  t->type = type;
-  t->next = type_alias;
-  type_alias = t;
-}
+type_and_name_t *parse_type_and_name();
 
-type_t *find_type_alias(token_t *name) {
-  type_alias_t *t = type_alias;
-  while (t) {
-    if (t->name->len == name->len &&
-        memcmp(t->name->str, name->str, name->len) == 0) {
-      return t->type;
+// parses the members of a struct definition after '{'
+void parse_struct_members(type_struct_t *s) {
+  size_t offset = 0;
+  type_and_name_t *t;
+  type_t *last;
+  while (1) {
+    t = parse_type_and_name();
+    if (!t) {
+      break;
+    }
+    expect(";");
+    s->member_names[s->member_count] = t->name;
+    s->member_types[s->member_count] = t->t;
+    s->member_offsets[s->member_count] = offset;
+    offset = offset + t->t->size;
+    if (offset % 4 != 0) {
+      offset = offset + 4 - (offset % 4);
     }
-    t = t->next;
+    ++s->member_count;
   }
-  return NULL;
+  expect("}");
+  if (s->member_count) {
+    last = s->member_types[s->member_count - 1];
+    s->type->size = s->member_offsets[s->member_count - 1] + last->size;
+  }
+  if (s->type->const_type) {
+    s->type->const_type->size = s->type->size;
+  }
+  s->defined = 1;
 }
 
-struct type_and_name_t {
+// a type without declarator, as in parameters and sizeof: "int", "char",
+// "void", "struct x" or a typedef name, followed by '*'s
+type_t *parse_type_name() {
+  token_t *tok;
   type_t *t;
-  token_t *name;
-};
-
-typedef struct type_and_name_t type_and_name_t;
+  bool is_const = consume_reserved(TK_CONST) != NULL;
+  if (consume_reserved(TK_STRUCT)) {
+    t = struct_type(consume_ident());
+  } else if ((tok = consume_any_type())) {
+    if (tok->kind == TK_TYPE_INT) {
+      t = type_int;
+    } else if (tok->kind == TK_TYPE_CHAR) {
+      t = type_char;
+    } else {
+      t = type_void;
+    }
+  } else {
+    t = find_type_alias(consume_ident());
+    if (!t) {
+      error("unknown type name");
+    }
+  }
+  if (is_const) {
+    t = const_of(t);
+  }
+  while (consume("*")) {
+    t = pointer_to(t);
+    if (consume_reserved(TK_CONST)) {
+      t = const_of(t);
+    }
+  }
+  return t;
+}
 
 type_and_name_t *parse_type_and_name() {
   type_and_name_t *a = NULL;
   token_t *tok;
-  type_t *tmp;
-  size_t offset = 0;
-  type_and_name_t *t;
+  int name;
+  int capacity = 0;
+  type_t **args = NULL;
   size_t i;
+  bool is_const = consume_reserved(TK_CONST) != NULL;
   tok = consume_any_type();
 
   if (!tok) {
     tok = consume_reserved(TK_STRUCT);
   }
-  if (!tok) {
-    tok = peek_ident();
+  if (!tok && peek_ident()) {
+    tok = cur_token();
   }
 
-  if (!tok) {
+  if (!tok && is_const) {
+    error("type name expected after const");
+  } else if (!tok) {
     return NULL;
   }
 
-  a = calloc(sizeof(type_and_name_t), 1);
+  a = arena_alloc(function_arena, sizeof(type_and_name_t));
   if (tok->kind == TK_TYPE_INT) {
-    a->t = new_type();
-    a->t->ty = TYPE_INT;
+    a->t = type_int;
   } else if (tok->kind == TK_TYPE_CHAR) {
-    a->t = new_type();
-    a->t->ty = TYPE_CHAR;
+    a->t = type_char;
   } else if (tok->kind == TK_TYPE_VOID) {
-    a->t = new_type();
-    a->t->ty = TYPE_VOID;
+    a->t = type_void;
   } else if (tok->kind == TK_STRUCT) {
-    tok = consume_ident();
-    a->t = new_type();
-    a->t->ty = TYPE_STRUCT;
-    a->t->struct_type = find_type_struct(tok);
-
-    if (!a->t->struct_type) {
-      // struct definition or opaque pointer
-      if (consume("{")) {
-        // struct definition
-        a->t->struct_type = new_type_struct();
-        while (1) {
-          t = parse_type_and_name();
-          if (!t) {
-            break;
-          }
-          expect(";");
-          a->t->struct_type->member_names[a->t->struct_type->member_count] =
-              t->name;
-          a->t->struct_type->member_types[a->t->struct_type->member_count] =
-              t->t;
-
-          a->t->struct_type->member_offsets[a->t->struct_type->member_count] =
-              offset;
-          offset =
-              offset + calc_size_of_type(
-                           a->t->struct_type
-                               ->member_types[a->t->struct_type->member_count]);
-          if (offset % 4 != 0) {
-            offset = offset + 4 - (offset % 4);
-          }
-          ++a->t->struct_type->member_count;
-        }
-        // register struct type
-        add_type_struct(tok, a->t->struct_type);
-
-        expect("}");
-        // expect(";");
-        return a;
-      } else {
-        // should be pointer of struct
-        a->t->struct_type = new_type_struct();
-        a->t->name = tok;
-
-        while (1) {
-          if (consume("*")) {
-            a->t = new_type_with(TYPE_POINTER, a->t);
-          } else {
-            break;
-          }
-        }
-        a->name = consume_ident();
-        // expect(";");
-
-        if (consume("[")) {
-          a->t = new_type_with(TYPE_ARRAY, a->t);
-          a->t->n = expect_int();
-          expect("]");
-        }
-
-        // function pointer in struct is not supported
-
-        return a;
+    a->t = struct_type(consume_ident());
+    if (consume("{")) {
+      // struct definition
+      if (a->t->struct_type->defined) {
+        error("redefinition of struct");
       }
+      parse_struct_members(a->t->struct_type);
+      return a;
     }
-    // struct variable (may be function definition)
+    // struct variable, pointer to a (maybe incomplete) struct or function
   } else {
-    a->t = find_type_alias(tok);
-    if (!a->t) {
+    a->t = find_type_alias(peek_ident());
+    if (!a->t && is_const) {
+      error("type name expected after const");
+    } else if (!a->t) {
       return NULL;
     }
     consume_ident();
   }
+  if (is_const) {
+    a->t = const_of(a->t);
+  }
 
-  while (!(tok = consume_ident_or_fail())) {
+  while (!(name = consume_ident_or_fail())) {
     consume("*");
-    a->t = new_type_with(TYPE_POINTER, a->t);
+    a->t = pointer_to(a->t);
+    if (consume_reserved(TK_CONST)) {
+      a->t = const_of(a->t);
+    }
   }
 
-  a->name = tok;
+  a->name = name;
 
   if (consume("[")) {
-    a->t = new_type_with(TYPE_ARRAY, a->t);
-    a->t->n = expect_int();
+    a->t = array_of(a->t, expect_int());
     expect("]");
   } else if (consume("(")) {
     // function
-    tmp = a->t;
-    a->t = new_type();
-    a->t->ret = tmp;
-    a->t->ty = TYPE_FUNCTION;
-    for (i = 0; i < MAX_ARGS; ++i) {
-      if (consume(")")) {
-        break;
-      }
+    for (i = 0; !consume(")"); ++i) {
       if (0 < i) {
         if (!consume(",")) {
           error("call f(x y)? needs comma?\n");
         }
       }
-      if (consume_reserved(TK_STRUCT)) {
-        tok = consume_ident();
-        a->t->args[i] = new_type();
-        a->t->args[i]->ty = TYPE_STRUCT;
-        a->t->args[i]->struct_type = find_type_struct(tok);
-      } else {
-        tok = consume_any_type();
-        if (!tok) {
-          tok = consume_ident();
-        }
-        if (tok->kind == TK_TYPE_INT) {
-          a->t->args[i] = new_type();
-          a->t->args[i]->ty = TYPE_INT;
-        } else if (tok->kind == TK_TYPE_CHAR) {
-          a->t->args[i] = new_type();
-          a->t->args[i]->ty = TYPE_CHAR;
-        } else if (tok->kind == TK_TYPE_VOID) {
-          a->t->args[i] = new_type();
-          a->t->args[i]->ty = TYPE_VOID;
-        } else {
-          a->t->args[i] = find_type_alias(tok);
-          if (!a->t) {
-            return NULL;
-          }
-        }
-      }
-
-      while (!(tok = consume_ident_or_fail())) {
-        assert(consume("*"));
-        a->t->args[i] = new_type_with(TYPE_POINTER, a->t->args[i]);
+      if (i == capacity) {
+        capacity = capacity * 2 + 8;
+        args = arena_grow(function_arena, args, i * sizeof(type_t *),
+                          capacity * sizeof(type_t *));
+        a->arg_names = arena_grow(function_arena, a->arg_names,
+                                  i * sizeof(int), capacity * sizeof(int));
       }
-
-      // tok = consume_ident();
-      a->t->arg_names[i] = tok;
-
-      a->t->arg_count = i + 1;
+      args[i] = parse_type_name();
+      a->arg_names[i] = consume_ident();
     }
+    a->t = function_type(a->t, args, i);
   }
   return a;
 }
 
 struct constant_string_t {
   struct constant_string_t *next;
-  token_t *tok;
+  char *str;  // including '"'s
+  int len;
   size_t id;
 };
 typedef struct constant_string_t constant_string_t;
 
+// strings of the current top-level declaration, emitted after its code
 constant_string_t *constant_string;
 size_t constant_string_count = 1;
 
 constant_string_t *add_constant_string(token_t *tok) {
-  constant_string_t *s = calloc(1, sizeof(constant_string_t));
+  constant_string_t *s =
+      arena_alloc(function_arena, sizeof(constant_string_t));
   s->next = constant_string;
-  s->tok = tok;
+  s->str = arena_alloc(function_arena, tok->len);
+  memcpy(s->str, token_str(tok), tok->len);
+  s->len = tok->len;
   s->id = constant_string_count;
   ++constant_string_count;
   constant_string = s;
@@ -759,18 +1168,19 @@ const node_kind_t NODE_DOT = 37;
 const node_kind_t NODE_ARROW = 38;
 // NODE_INDEX, // a[i] -> *(a + i)
 
-#define MAX_STATEMENTS 1024
 struct node_t {
   node_kind_t kind;
   struct node_t *lhs;
   struct node_t *rhs;
   int val;      // for NODE_NUM
-  int offset;   // for NODE_LOCAL_VARIABLE, from fp, or for NODE_STRUCT_MEMBER
+  int offset;   // for NODE_LOCAL_VARIABLE, in the frame, or for
+                // NODE_STRUCT_MEMBER
   bool ignore;  // if 1, then pop(ignore) the value
   type_t *type;
 
   // for variable
-  token_t *name;
+  int name;
+  struct local_variable_t *local;  // for NODE_LOCAL_VARIABLE
 
   // for 'if'/'while'
   struct node_t *cond;
@@ -786,103 +1196,132 @@ struct node_t {
   // for 'const string'
   constant_string_t *const_str;
 
-  // for 'call'
-  struct node_t *args[MAX_ARGS];
-  size_t args_count;
-
-  // for 'block'
-  struct node_t *statements[MAX_STATEMENTS];
-  size_t statement_count;
+  // arguments of 'call' or statements of 'block', exactly sized
+  struct node_t **children;
+  int child_count;
 };
 typedef struct node_t node_t;
 
+// child lists are collected on a shared stack while they are parsed, so
+// that nested lists need no temporary arrays of their own
+node_t **node_stack;
+int node_stack_len;
+int node_stack_capacity;
+
+void push_node(node_t *node) {
+  if (node_stack_len == node_stack_capacity) {
+    node_stack_capacity = node_stack_capacity * 2 + 256;
+    node_stack = realloc(node_stack, node_stack_capacity * sizeof(node_t *));
+  }
+  node_stack[node_stack_len] = node;
+  ++node_stack_len;
+}
+
+// moves the nodes pushed since `mark` into an exactly sized array
+node_t **pop_nodes(int mark) {
+  int i;
+  node_t **nodes = arena_alloc(function_arena,
+                               (node_stack_len - mark + 1) * sizeof(node_t *));
+  for (i = mark; i < node_stack_len; ++i) {
+    nodes[i - mark] = node_stack[i];
+  }
+  node_stack_len = mark;
+  return nodes;
+}
+
 struct local_variable_t {
   struct local_variable_t *next;
-  token_t *name;
+  int name;
   size_t size;
   size_t size_on_stack;  // aligned size
-  int offset;            // from fp
+  int offset;            // in the frame
   type_t *type;
+  struct local_variable_t *shadowed;  // same name in an outer scope
+  bool escapes;  // its address is taken, so it has to live in memory
+  int reg;       // virtual register holding it, 0 if it is in memory
+  struct local_variable_t *copy;  // in a body kept for inlining
 };
 typedef struct local_variable_t local_variable_t;
 
+// all local variables of the current function, latest first
 local_variable_t *local_variables = NULL;
 
-local_variable_t *find_local_variable(token_t *name) {
-  local_variable_t *var;
-  for (var = local_variables; var; var = var->next) {
-    if (var->name->len == name->len &&
-        !memcmp(name->str, var->name->str, var->name->len)) {
-      return var;
-    }
-  }
-  return NULL;
-}
+local_variable_t *find_local_variable(int name) { return idents[name].local; }
 
+// variables are laid out in declaration order, so the latest one ends the
+// frame
 size_t calc_total_local_variable_size_on_stack(local_variable_t *var) {
-  size_t size = 0;
-  while (var) {
-    size = size + var->size_on_stack;
-    var = var->next;
+  if (!var) {
+    return 0;
   }
-  return size;
+  return var->offset + var->size_on_stack;
 }
 
-void add_local_variable(token_t *name, type_t *ty) {
-  local_variable_t *lvar = calloc(1, sizeof(local_variable_t));
+local_variable_t *add_local_variable(int name, type_t *ty) {
+  local_variable_t *lvar =
+      arena_alloc(function_arena, sizeof(local_variable_t));
   lvar->next = local_variables;
   lvar->name = name;
   lvar->type = ty;
-  lvar->size = calc_size_of_type(ty);
+  lvar->size = ty->size;
   lvar->size_on_stack = (lvar->size + 3) / 4 * 4;  // align 4
   lvar->offset = calc_total_local_variable_size_on_stack(local_variables);
+  lvar->shadowed = idents[name].local;
+  idents[name].local = lvar;
   local_variables = lvar;
+  return lvar;
+}
+
+// a scope is represented by the head of local_variables when it is entered.
+// leaving it unbinds the variables declared since then.
+local_variable_t *enter_scope() { return local_variables; }
+
+void leave_scope(local_variable_t *scope) {
+  local_variable_t *var;
+  for (var = local_variables; var != scope; var = var->next) {
+    idents[var->name].local = var->shadowed;
+  }
 }
 
 struct global_variable_t {
   struct global_variable_t *next;
-  token_t *name;
+  int name;
   size_t size;
   type_t *type;
 
-  constant_string_t *constant_string;  // for string
+  // a const int with an initializer is a compile-time constant. fold()
+  // replaces its uses, and it only gets storage if its address is taken
+  bool has_value;
+  int value;
+  bool referenced;
+  bool is_static;  // not visible outside the file
 };
 typedef struct global_variable_t global_variable_t;
 
 // global variable
 global_variable_t *global_variables = NULL;
 
-global_variable_t *find_global_variable(token_t *tok) {
-  global_variable_t *var;
-  for (var = global_variables; var; var = var->next) {
-    if (var->name->len == tok->len &&
-        !memcmp(tok->str, var->name->str, var->name->len)) {
-      return var;
-    }
-  }
-  return NULL;
+global_variable_t *find_global_variable(int name) {
+  return idents[name].global;
 }
 
-void add_global_variable(token_t *name, type_t *ty) {
-  global_variable_t *var = calloc(1, sizeof(global_variable_t));
+global_variable_t *add_global_variable(int name, type_t *ty) {
+  global_variable_t *var =
+      arena_alloc(program_arena, sizeof(global_variable_t));
   var->next = global_variables;
   var->name = name;
   var->type = ty;
-  var->size = calc_size_of_type(ty);
+  var->size = ty->size;
   global_variables = var;
+  idents[name].global = var;
+  return var;
 }
 
-constant_string_t *add_global_variable_with_constant_string(token_t *name,
+constant_string_t *add_global_variable_with_constant_string(int name,
                                                             type_t *ty,
                                                             token_t *tok) {
-  global_variable_t *var = calloc(1, sizeof(global_variable_t));
-  var->constant_string = add_constant_string(tok);
-  var->next = global_variables;
-  var->name = name;
-  var->type = ty;
-  var->size = calc_size_of_type(ty);
-  global_variables = var;
-  return var->constant_string;
+  add_global_variable(name, ty);
+  return add_constant_string(tok);
 }
 
 typedef int declaration_type_t;
@@ -894,32 +1333,35 @@ const declaration_type_t DECLARATION_TYPEDEF = 3;
 
 struct declaration_t {
   declaration_type_t declaration_type;
-  token_t *name;
+  int name;
   type_t *type;
 
-  token_t *func_arg[MAX_ARGS];
+  local_variable_t **func_args;
   size_t func_arg_count;
 
-  node_t *func_statements[MAX_STATEMENTS];
+  node_t **func_statements;
   size_t func_statement_count;
 
   constant_string_t *constant_string;
   int constant_int;
+
+  bool is_static;
+  bool is_inline;  // a hint to expand calls to it, see keep_inline_body()
 };
 typedef struct declaration_t declaration_t;
 
 declaration_t *new_declaration() {
-  declaration_t *d = calloc(1, sizeof(declaration_t));
+  declaration_t *d = arena_alloc(function_arena, sizeof(declaration_t));
   return d;
 }
 
-node_t *new_node() { return calloc(1, sizeof(node_t)); }
+node_t *new_node() { return arena_alloc(function_arena, sizeof(node_t)); }
 
 node_t *parse_int() {
   node_t *node = new_node();
   node->kind = NODE_NUM;
   node->val = expect_int();
-  node->type = new_type_with(TYPE_INT, NULL);
+  node->type = type_int;
   return node;
 }
 
@@ -983,11 +1425,12 @@ node_t *parse_follower(node_t *leader, char *op, int right_binding_power,
 node_t *parse_exp(int min_bind_pow) {
   node_t *node = new_node();
   token_t *tok;
-  type_t *type;
-  type_struct_t *struc;
+  int name;
   size_t i;
+  int mark;
   local_variable_t *lvar;
   global_variable_t *gvar;
+  type_t *type;
 
   // parse leading operator
   if (consume("-")) {
@@ -1016,7 +1459,7 @@ node_t *parse_exp(int min_bind_pow) {
     node->rhs->rhs = new_node();
     node->rhs->rhs->kind = NODE_NUM;
     node->rhs->rhs->val = 1;
-    node->rhs->rhs->type = new_type_with(TYPE_INT, NULL);
+    node->rhs->rhs->type = type_int;
   } else if (consume("--")) {
     node_t *follower = parse_exp(PRE_INC_RIGHT_BIND_POW);
     node->kind = NODE_ASSIGN;
@@ -1027,7 +1470,7 @@ node_t *parse_exp(int min_bind_pow) {
     node->rhs->rhs = new_node();
     node->rhs->rhs->kind = NODE_NUM;
     node->rhs->rhs->val = 1;
-    node->rhs->rhs->type = new_type_with(TYPE_INT, NULL);
+    node->rhs->rhs->type = type_int;
   } else if (consume("(")) {
     node = parse_exp(0);
     expect(")");
@@ -1038,61 +1481,45 @@ node_t *parse_exp(int min_bind_pow) {
     node->const_str = add_constant_string(tok);
   } else if ((tok = consume_reserved(TK_SIZEOF))) {
     expect("(");
-    node->type = new_type_with(TYPE_INT, NULL);
+    node->type = type_int;
     node->kind = NODE_NUM;
-    if ((tok = consume_reserved(TK_TYPE_INT))) {
-      node->val = 4;
-    } else if ((tok = consume_reserved(TK_TYPE_CHAR))) {
-      node->val = 1;
-    } else if ((tok = consume_reserved(TK_STRUCT))) {
-      tok = consume_ident();
-      struc = find_type_struct(tok);
-      node->val = calc_size_of_struct(struc);
-    } else {
-      tok = consume_ident();
-      type = find_type_alias(tok);
-      if (!type) {
-        error("not found type_alias, sizeof");
-      }
-      node->val = calc_size_of_type(type);
-    }
+    type = parse_type_name();
+    node->val = type->size;
     expect(")");
   } else {
-    tok = consume_ident();
+    name = consume_ident();
     if (consume("(")) {
       // function call
       node->kind = NODE_CALL;
-      node->name = tok;
-      for (i = 0; i < MAX_ARGS; ++i) {
-        if (consume(")")) {
-          break;
-        }
+      node->name = name;
+      mark = node_stack_len;
+      for (i = 0; !consume(")"); ++i) {
         if (0 < i) {
           if (!consume(",")) {
             error("call f(x y)? needs comma?\n");
           }
         }
-        node->args[i] = parse_exp(0);
-        node->args_count = i + 1;
+        push_node(parse_exp(0));
       }
+      node->child_count = i;
+      node->children = pop_nodes(mark);
     } else {
       // variable
-      lvar = find_local_variable(tok);
-      gvar = find_global_variable(tok);
+      lvar = find_local_variable(name);
+      gvar = find_global_variable(name);
       if (lvar) {
         node->kind = NODE_LOCAL_VARIABLE;
+        node->local = lvar;
         node->offset = lvar->offset;
         node->type = lvar->type;
       } else if (gvar) {
         node->kind = NODE_GLOBAL_VARIABLE;
         node->type = gvar->type;
-        node->name = gvar->name;
       } else {
         // skip for now, because of struct member access
         node->kind = NODE_STRUCT_MEMBER;
-        node->name = tok;
       }
-      node->name = tok;
+      node->name = name;
     }
   }
 
@@ -1223,7 +1650,7 @@ node_t *parse_exp(int min_bind_pow) {
       // inc->rhs->rhs = new_node();
       // inc->rhs->rhs->kind = NODE_NUM;
       // inc->rhs->rhs->val = 1;
-      // inc->rhs->rhs->type = new_type_with(TYPE_INT, NULL);
+      // inc->rhs->rhs->type = type_int;
       // node = parse_follower(inc, "++", 0, NODE_ASSIGN);
     } else {
       return node;
@@ -1232,20 +1659,21 @@ node_t *parse_exp(int min_bind_pow) {
 }
 
 node_t *parse_stmt() {
-  size_t i;
   node_t *node = new_node();
   type_and_name_t *type_and_name = parse_type_and_name();
   local_variable_t *lvar;
+  local_variable_t *scope;
+  int mark;
 
   if (type_and_name) {
     node->kind = NODE_VAR_DEC;
     node->name = type_and_name->name;
 
-    add_local_variable(node->name, type_and_name->t);
+    lvar = add_local_variable(node->name, type_and_name->t);
     if (consume("=")) {
-      lvar = find_local_variable(node->name);
       node->lhs = new_node();
       node->lhs->kind = NODE_LOCAL_VARIABLE;
+      node->lhs->local = lvar;
       node->lhs->name = lvar->name;
       node->lhs->offset = lvar->offset;
       node->lhs->type = lvar->type;
@@ -1300,13 +1728,14 @@ node_t *parse_stmt() {
     node->clause_then = parse_stmt();
   } else if (consume("{")) {
     node->kind = NODE_BLOCK;
-    for (i = 0; i < MAX_STATEMENTS && !consume("}"); ++i) {
-      node->statements[i] = parse_stmt();
-      ++node->statement_count;
-    }
-    if (i == MAX_STATEMENTS) {
-      error("too many statements in a block");
+    scope = enter_scope();
+    mark = node_stack_len;
+    while (!consume("}")) {
+      push_node(parse_stmt());
+      ++node->child_count;
     }
+    node->children = pop_nodes(mark);
+    leave_scope(scope);
   } else {
     node = parse_exp(0);
     node->ignore = 1;
@@ -1319,9 +1748,9 @@ void add_type(node_t *node) {
   size_t i;
 
   if (node->kind == NODE_NUM) {
-    node->type = new_type_with(TYPE_INT, NULL);
+    node->type = type_int;
   } else if (node->kind == NODE_CONST_STRING) {
-    node->type = new_type_with(TYPE_POINTER, new_type_with(TYPE_CHAR, NULL));
+    node->type = pointer_to(type_char);
   } else if (node->kind == NODE_MINUS) {
     add_type(node->rhs);
     node->type = node->rhs->type;
@@ -1346,14 +1775,13 @@ void add_type(node_t *node) {
     add_type(node->lhs);
     add_type(node->rhs);
     node->type = node->lhs->type;
+    if (node->kind == NODE_ASSIGN && node->type->is_const) {
+      error("assignment to a const object");
+    }
   } else if (node->kind == NODE_DOT) {
     add_type(node->lhs);
     assert(node->lhs->type->ty == TYPE_STRUCT);
-
-    if (node->lhs->type->struct_type->member_count == 0) {
-      node->lhs->type->struct_type = find_type_struct(node->lhs->type->name);
-    }
-    assert(node->lhs->type->struct_type->member_count > 0);
+    assert(node->lhs->type->struct_type->defined);
     // assert(node->rhs->kind == NODE_STRUCT_MEMBER);
     i = get_member_index(node->lhs->type->struct_type, node->rhs->name);
     node->rhs->kind = NODE_STRUCT_MEMBER;
@@ -1364,12 +1792,7 @@ void add_type(node_t *node) {
     add_type(node->lhs);
     assert(node->lhs->type->ty == TYPE_POINTER);
     assert(node->lhs->type->ptr_to->ty == TYPE_STRUCT);
-
-    if (node->lhs->type->ptr_to->struct_type->member_count == 0) {
-      node->lhs->type->ptr_to->struct_type =
-          find_type_struct(node->lhs->type->ptr_to->name);
-    }
-    assert(node->lhs->type->ptr_to->struct_type->member_count > 0);
+    assert(node->lhs->type->ptr_to->struct_type->defined);
     // assert(node->rhs->kind == NODE_STRUCT_MEMBER);
     i = get_member_index(node->lhs->type->ptr_to->struct_type, node->rhs->name);
     node->rhs->kind = NODE_STRUCT_MEMBER;
@@ -1380,9 +1803,9 @@ void add_type(node_t *node) {
     if (node->rhs) {
       add_type(node->rhs);
     }
-    node->type = new_type_with(TYPE_VOID, NULL);
+    node->type = type_void;
   } else if (node->kind == NODE_BREAK || node->kind == NODE_CONTINUE) {
-    node->type = new_type_with(TYPE_VOID, NULL);
+    node->type = type_void;
   } else if (node->kind == NODE_IF || node->kind == NODE_WHILE ||
              node->kind == NODE_FOR) {
     if (node->init) {
@@ -1400,12 +1823,12 @@ void add_type(node_t *node) {
     if (node->next) {
       add_type(node->next);
     }
-    node->type = new_type_with(TYPE_VOID, NULL);
+    node->type = type_void;
   } else if (node->kind == NODE_BLOCK) {
-    for (i = 0; i < node->statement_count; ++i) {
-      add_type(node->statements[i]);
+    for (i = 0; i < node->child_count; ++i) {
+      add_type(node->children[i]);
     }
-    node->type = new_type_with(TYPE_VOID, NULL);
+    node->type = type_void;
   } else if (node->kind == NODE_LOCAL_VARIABLE ||
              node->kind == NODE_GLOBAL_VARIABLE) {
     // typed in parsing
@@ -1413,13 +1836,13 @@ void add_type(node_t *node) {
       error("type is not set");
     }
   } else if (node->kind == NODE_CALL) {
-    for (i = 0; i < node->args_count; ++i) {
-      add_type(node->args[i]);
+    for (i = 0; i < node->child_count; ++i) {
+      add_type(node->children[i]);
     }
-    node->type = new_type_with(TYPE_VOID, NULL);
+    node->type = type_void;
   } else if (node->kind == NODE_ADDR) {
     add_type(node->rhs);
-    node->type = new_type_with(TYPE_POINTER, node->rhs->type);
+    node->type = pointer_to(node->rhs->type);
   } else if (node->kind == NODE_DEREF) {
     add_type(node->rhs);
     node->type = node->rhs->type->ptr_to;
@@ -1442,11 +1865,296 @@ void add_type(node_t *node) {
   }
 }
 
+// constant folding and algebraic simplification on the typed AST. fold()
+// returns the node to use in place of the given one, typed as before
+int fold_constant_count = 0;  // operations evaluated at compile time
+int fold_identity_count = 0;  // x + 0, x * 1, x * 0 and the like
+int fold_branch_count = 0;    // conditions known at compile time
+
+node_t *new_num(int val) {
+  node_t *node = new_node();
+  node->kind = NODE_NUM;
+  node->val = val;
+  node->type = type_int;
+  return node;
+}
+
+node_t *new_empty_block() {
+  node_t *node = new_node();
+  node->kind = NODE_BLOCK;
+  node->type = type_void;
+  return node;
+}
+
+bool is_num(node_t *node, int val) {
+  return node->kind == NODE_NUM && node->val == val;
+}
+
+bool is_boolean(node_t *node) {
+  return node->kind == NODE_EQ || node->kind == NODE_NEQ ||
+         node->kind == NODE_LT || node->kind == NODE_LE ||
+         node->kind == NODE_GT || node->kind == NODE_GE ||
+         node->kind == NODE_LOGICAL_AND || node->kind == NODE_LOGICAL_OR ||
+         node->kind == NODE_LOGICAL_NOT;
+}
+
+// whether evaluating the expression has no effect besides its value
+bool is_pure(node_t *node) {
+  if (!node) {
+    return 1;
+  }
+  if (node->kind == NODE_ASSIGN || node->kind == NODE_CALL) {
+    return 0;
+  }
+  return is_pure(node->lhs) && is_pure(node->rhs);
+}
+
+// node != 0, for the value of a node used as a condition
+node_t *new_truth(node_t *node) {
+  node_t *truth;
+  if (is_boolean(node)) {
+    return node;
+  }
+  truth = new_node();
+  truth->kind = NODE_NEQ;
+  truth->lhs = node;
+  truth->rhs = new_num(0);
+  truth->type = type_int;
+  return truth;
+}
+
+// lhs op rhs of constants, or NULL when it is left to run time
+node_t *fold_constant_binary(node_t *node) {
+  int kind = node->kind;
+  int lhs = node->lhs->val;
+  int rhs = node->rhs->val;
+  int val;
+  if ((kind == NODE_DIV || kind == NODE_MOD) && rhs == 0) {
+    return NULL;  // traps at run time
+  }
+  if (kind == NODE_ADD) {
+    val = lhs + rhs;
+  } else if (kind == NODE_SUB) {
+    val = lhs - rhs;
+  } else if (kind == NODE_MUL) {
+    val = lhs * rhs;
+  } else if (kind == NODE_DIV && rhs == -1) {
+    val = -lhs;  // the most negative int divided by -1 traps on some hosts
+  } else if (kind == NODE_DIV) {
+    val = lhs / rhs;
+  } else if (kind == NODE_MOD && rhs == -1) {
+    val = 0;
+  } else if (kind == NODE_MOD) {
+    val = lhs % rhs;
+  } else if (kind == NODE_EQ) {
+    val = lhs == rhs;
+  } else if (kind == NODE_NEQ) {
+    val = lhs != rhs;
+  } else if (kind == NODE_LT) {
+    val = lhs < rhs;
+  } else if (kind == NODE_LE) {
+    val = lhs <= rhs;
+  } else if (kind == NODE_GT) {
+    val = lhs > rhs;
+  } else if (kind == NODE_GE) {
+    val = lhs >= rhs;
+  } else if (kind == NODE_LOGICAL_AND) {
+    val = lhs && rhs;
+  } else if (kind == NODE_LOGICAL_OR) {
+    val = lhs || rhs;
+  } else if (kind == NODE_BITWISE_AND) {
+    val = lhs & rhs;
+  } else if (kind == NODE_BITWISE_OR) {
+    val = lhs | rhs;
+  } else if (kind == NODE_BITWISE_XOR) {
+    val = lhs ^ rhs;
+  } else {
+    return NULL;
+  }
+  ++fold_constant_count;
+  return new_num(val);
+}
+
+// identities and annihilators with one constant operand, or NULL. an
+// operand is only dropped when it has no side effects
+node_t *simplify_binary(node_t *node) {
+  int kind = node->kind;
+  node_t *lhs = node->lhs;
+  node_t *rhs = node->rhs;
+  if ((kind == NODE_ADD || kind == NODE_BITWISE_OR ||
+       kind == NODE_BITWISE_XOR) &&
+      is_num(lhs, 0)) {
+    return rhs;
+  } else if ((kind == NODE_ADD || kind == NODE_SUB ||
+              kind == NODE_BITWISE_OR || kind == NODE_BITWISE_XOR) &&
+             is_num(rhs, 0)) {
+    return lhs;
+  } else if ((kind == NODE_MUL && is_num(lhs, 1)) ||
+             (kind == NODE_BITWISE_AND && is_num(lhs, -1))) {
+    return rhs;
+  } else if (((kind == NODE_MUL || kind == NODE_DIV) && is_num(rhs, 1)) ||
+             (kind == NODE_BITWISE_AND && is_num(rhs, -1))) {
+    return lhs;
+  } else if ((kind == NODE_MUL || kind == NODE_BITWISE_AND) &&
+             ((is_num(lhs, 0) && is_pure(rhs)) ||
+              (is_num(rhs, 0) && is_pure(lhs)))) {
+    return new_num(0);
+  } else if (kind == NODE_MOD && is_num(rhs, 1) && is_pure(lhs)) {
+    return new_num(0);
+  } else if (kind == NODE_BITWISE_OR &&
+             ((is_num(lhs, -1) && is_pure(rhs)) ||
+              (is_num(rhs, -1) && is_pure(lhs)))) {
+    return new_num(-1);
+  } else if (kind == NODE_SUB && is_num(lhs, 0) &&
+             rhs->type->ty != TYPE_POINTER) {
+    node->kind = NODE_MINUS;
+    node->lhs = NULL;
+    return node;
+  } else if (kind == NODE_LOGICAL_AND && lhs->kind == NODE_NUM) {
+    if (lhs->val) {
+      return new_truth(rhs);
+    }
+    return new_num(0);
+  } else if (kind == NODE_LOGICAL_OR && lhs->kind == NODE_NUM) {
+    if (lhs->val) {
+      return new_num(1);
+    }
+    return new_truth(rhs);
+  } else if ((kind == NODE_LOGICAL_AND && rhs->kind == NODE_NUM &&
+              rhs->val) ||
+             (kind == NODE_LOGICAL_OR && is_num(rhs, 0))) {
+    return new_truth(lhs);
+  } else if (kind == NODE_LOGICAL_AND && is_num(rhs, 0) && is_pure(lhs)) {
+    return new_num(0);
+  } else if (kind == NODE_LOGICAL_OR && rhs->kind == NODE_NUM &&
+             is_pure(lhs)) {
+    return new_num(1);
+  }
+  return NULL;
+}
+
+node_t *fold_unary(node_t *node) {
+  node_t *rhs = node->rhs;
+  if (rhs->kind == NODE_NUM) {
+    ++fold_constant_count;
+    if (node->kind == NODE_MINUS) {
+      return new_num(-rhs->val);
+    }
+    return new_num(!rhs->val);
+  }
+  if (node->kind == NODE_MINUS && rhs->kind == NODE_MINUS) {
+    ++fold_identity_count;
+    return rhs->rhs;
+  }
+  return NULL;
+}
+
+// if and loops whose condition is constant need no test
+node_t *fold_branch(node_t *node) {
+  if (!node->cond || node->cond->kind != NODE_NUM) {
+    return NULL;
+  }
+  ++fold_branch_count;
+  if (node->kind == NODE_IF && node->cond->val) {
+    return node->clause_then;
+  } else if (node->kind == NODE_IF && node->clause_else) {
+    return node->clause_else;
+  } else if (node->kind == NODE_IF) {
+    return new_empty_block();
+  } else if (node->cond->val) {
+    node->cond = NULL;
+    return node;
+  } else if (node->init) {
+    return node->init;  // the body never runs
+  }
+  return new_empty_block();
+}
+
+// v converted to a signed char
+int char_value(int v) {
+  v = (v % 256 + 256) % 256;
+  if (128 <= v) {
+    v = v - 256;
+  }
+  return v;
+}
+
+// the value of a global constant where it is read
+node_t *fold_global(node_t *node) {
+  global_variable_t *var = find_global_variable(node->name);
+  if (!var->has_value) {
+    return node;
+  }
+  ++fold_constant_count;
+  return new_num(var->value);
+}
+
+node_t *fold(node_t *node) {
+  size_t i;
+  node_t *folded = NULL;
+
+  if (!node) {
+    return NULL;
+  }
+  if (node->kind == NODE_GLOBAL_VARIABLE) {
+    return fold_global(node);
+  }
+  if (node->lhs) {
+    node->lhs = fold(node->lhs);
+  }
+  if (node->rhs && !(node->kind == NODE_ADDR &&
+                     node->rhs->kind == NODE_GLOBAL_VARIABLE)) {
+    node->rhs = fold(node->rhs);
+  }
+  if (node->kind == NODE_IF || node->kind == NODE_WHILE ||
+      node->kind == NODE_FOR) {
+    node->init = fold(node->init);
+    node->cond = fold(node->cond);
+    node->next = fold(node->next);
+    node->clause_then = fold(node->clause_then);
+    node->clause_else = fold(node->clause_else);
+  }
+  for (i = 0; i < node->child_count; ++i) {
+    node->children[i] = fold(node->children[i]);
+  }
+
+  if (node->kind == NODE_MINUS || node->kind == NODE_LOGICAL_NOT) {
+    folded = fold_unary(node);
+  } else if (node->kind == NODE_IF || node->kind == NODE_WHILE ||
+             node->kind == NODE_FOR) {
+    folded = fold_branch(node);
+  } else if (node->lhs && node->rhs && node->lhs->kind == NODE_NUM &&
+             node->rhs->kind == NODE_NUM) {
+    folded = fold_constant_binary(node);
+  }
+  if (!folded && node->lhs && node->rhs) {
+    folded = simplify_binary(node);
+    if (folded) {
+      ++fold_identity_count;
+    }
+  }
+  if (folded) {
+    return folded;
+  }
+  return node;
+}
+
+void print_fold_report(char *path) {
+  if (!path) {
+    path = "<stdin>";
+  }
+  eprintf("fold %s: %d constants, %d identities, %d branches\n", path,
+          fold_constant_count, fold_identity_count, fold_branch_count);
+}
+
 declaration_t *parse_declaration() {
   size_t i;
+  int mark;
+  node_t *last = NULL;
   declaration_t *d = new_declaration();
   type_and_name_t *type_and_name;
   token_t *tok;
+  global_variable_t *gvar;
 
   if (consume_reserved(TK_TYPEDEF)) {
     d->declaration_type = DECLARATION_TYPEDEF;
@@ -1458,9 +2166,18 @@ declaration_t *parse_declaration() {
     return d;
   }
 
+  while (1) {
+    if (consume_reserved(TK_STATIC)) {
+      d->is_static = 1;
+    } else if (consume_reserved(TK_INLINE)) {
+      d->is_inline = 1;
+    } else {
+      break;
+    }
+  }
   type_and_name = parse_type_and_name();
   if (consume(";")) {
-    if (type_and_name->name == NULL) {
+    if (type_and_name->name == 0) {
       // struct definition
       return NULL;
     } else if (type_and_name->t->ty == TYPE_FUNCTION) {
@@ -1470,7 +2187,8 @@ declaration_t *parse_declaration() {
       d->declaration_type = DECLARATION_GLOBAL_VARIABLE;
       d->type = type_and_name->t;
       d->name = type_and_name->name;
-      add_global_variable(type_and_name->name, type_and_name->t);
+      gvar = add_global_variable(type_and_name->name, type_and_name->t);
+      gvar->is_static = d->is_static;
       return d;
     }
   }
@@ -1482,9 +2200,20 @@ declaration_t *parse_declaration() {
     if ((tok = consume_reserved(TK_STRING))) {
       d->constant_string = add_global_variable_with_constant_string(
           type_and_name->name, type_and_name->t, tok);
-    } else if ((tok = consume_reserved(TK_INT))) {
-      d->constant_int = tok->num;
-      add_global_variable(d->name, d->type);
+      gvar = find_global_variable(d->name);
+      gvar->is_static = d->is_static;
+    } else if (is_int()) {
+      d->constant_int = expect_int();
+      if (d->type->ty == TYPE_CHAR) {
+        d->constant_int = char_value(d->constant_int);
+      }
+      gvar = add_global_variable(d->name, d->type);
+      gvar->is_static = d->is_static;
+      if (d->type->is_const &&
+          (d->type->ty == TYPE_INT || d->type->ty == TYPE_CHAR)) {
+        gvar->has_value = 1;
+        gvar->value = d->constant_int;
+      }
     }
     expect(";");
     return d;
@@ -1494,67 +2223,43 @@ declaration_t *parse_declaration() {
     error("failed to parse declaration: '{' expected");
   }
 
-  if (type_and_name->t->ty == TYPE_STRUCT &&
-      !find_type_struct(type_and_name->name)) {
-    type_struct_t *ts = new_type_struct();
-    size_t offset = 0;
-    size_t index = 0;
-
-    ts->name = type_and_name->name;
-
-    // struct definition
-    while (!consume("}")) {
-      type_and_name_t *tn = parse_type_and_name();
-      ts->member_names[index] = tn->name;
-      ts->member_types[index] = tn->t;
-      ts->member_offsets[index] = offset;
-      ts->member_count = index + 1;
-      consume(";");
-    }
-    ts->next = type_struct;
-    type_struct = ts;
-    return NULL;
-  }
-
   assert(type_and_name->t->ty == TYPE_FUNCTION);
   d->declaration_type = DECLARATION_FUNCTION;
   d->type = type_and_name->t;
-  d->func_arg_count = type_and_name->t->arg_count;
+  d->func_arg_count = type_and_name->t->n;
   d->name = type_and_name->name;
 
+  d->func_args = arena_alloc(function_arena, (d->func_arg_count + 1) *
+                                                 sizeof(local_variable_t *));
   for (i = 0; i < d->func_arg_count; ++i) {
-    d->func_arg[i] = type_and_name->t->arg_names[i];
-    add_local_variable(d->func_arg[i], type_and_name->t->args[i]);
+    d->func_args[i] = add_local_variable(type_and_name->arg_names[i],
+                                         type_and_name->t->args[i]);
   }
 
-  for (i = 0; i < MAX_STATEMENTS; ++i) {
-    if (consume("}")) {
-      break;
-    }
-    d->func_statements[i] = parse_stmt();
-    add_type(d->func_statements[i]);
-    d->func_statement_count = i + 1;
-  }
-  if (i == MAX_STATEMENTS) {
-    error("too many statements in a block");
+  mark = node_stack_len;
+  while (!consume("}")) {
+    last = parse_stmt();
+    add_type(last);
+    last = fold(last);
+    push_node(last);
+    ++d->func_statement_count;
   }
+  leave_scope(NULL);
 
-  if (d->func_statement_count == 0 ||
-      d->func_statements[d->func_statement_count - 1]->kind != NODE_RETURN) {
-    d->func_statements[d->func_statement_count] = new_node();
-    d->func_statements[d->func_statement_count]->kind = NODE_RETURN;
+  if (d->func_statement_count == 0 || last->kind != NODE_RETURN) {
+    last = new_node();
+    last->kind = NODE_RETURN;
+    push_node(last);
     ++d->func_statement_count;
   }
+  d->func_statements = pop_nodes(mark);
 
   return d;
 }
 
-void print_str_len(FILE *fp, char *str, size_t len) {
-  char *name = calloc(len + 1, 1);
-  memcpy(name, str, len);
-  fprintf(fp, "%s", name);
-  free(name);
-}
+// diagnostic dumps on stderr, enabled by --trace=ast,gen
+bool trace_ast = 0;  // every declaration after parsing
+bool trace_gen = 0;  // every node visited by gen
 
 void print_node(node_t *node);
 
@@ -1614,11 +2319,11 @@ void print_node(node_t *node) {
   } else if (node->kind == NODE_NUM) {
     eprintf("%d", node->val);
   } else if (node->kind == NODE_CONST_STRING) {
-    eprintf("%.*s", node->const_str->tok->len, node->const_str->tok->str);
+    eprintf("%.*s", node->const_str->len, node->const_str->str);
   } else if (node->kind == NODE_LOCAL_VARIABLE ||
              node->kind == NODE_GLOBAL_VARIABLE ||
              node->kind == NODE_STRUCT_MEMBER) {
-    eprintf("%.*s", node->name->len, node->name->str);
+    eprintf("%.*s", ident_len(node->name), ident_str(node->name));
   } else if (node->kind == NODE_ASSIGN) {
     print_node_binop(node, "=");
   } else if (node->kind == NODE_RETURN) {
@@ -1642,7 +2347,11 @@ void print_node(node_t *node) {
     }
   } else if (node->kind == NODE_WHILE) {
     eprintf("while (");
-    print_node(node->cond);
+    if (node->cond) {
+      print_node(node->cond);
+    } else {
+      eprintf("1");  // folded to always true
+    }
     eprintf(") ");
     print_node(node->clause_then);
   } else if (node->kind == NODE_FOR) {
@@ -1656,18 +2365,18 @@ void print_node(node_t *node) {
     print_node(node->clause_then);
   } else if (node->kind == NODE_BLOCK) {
     eprintf("{ ");
-    for (i = 0; i < node->statement_count; ++i) {
-      print_node(node->statements[i]);
+    for (i = 0; i < node->child_count; ++i) {
+      print_node(node->children[i]);
     }
     eprintf("}");
   } else if (node->kind == NODE_CALL) {
-    eprintf("%.*s", node->name->len, node->name->str);
+    eprintf("%.*s", ident_len(node->name), ident_str(node->name));
     eprintf("(");
-    for (i = 0; i < node->args_count; ++i) {
+    for (i = 0; i < node->child_count; ++i) {
       if (0 < i) {
         eprintf(", ");
       }
-      print_node(node->args[i]);
+      print_node(node->children[i]);
     }
     eprintf(")");
   } else if (node->kind == NODE_ADDR) {
@@ -1681,7 +2390,7 @@ void print_node(node_t *node) {
     print_node(node->rhs);
   } else if (node->kind == NODE_VAR_DEC) {
     eprintf("int ");
-    eprintf("%.*s", node->name->len, node->name->str);
+    eprintf("%.*s", ident_len(node->name), ident_str(node->name));
     eprintf(";\n");
   } else {
     eprintf("unimplemented printer: %d\n", node->kind);
@@ -1692,7 +2401,7 @@ void print_node(node_t *node) {
 void print_declaration(declaration_t *dec) {
   size_t i;
   print_type(dec->type);
-  eprintf("%.*s", dec->name->len, dec->name->str);
+  eprintf("%.*s", ident_len(dec->name), ident_str(dec->name));
   if (dec->declaration_type == DECLARATION_GLOBAL_VARIABLE) {
     eprintf(";\n");
   } else if (dec->declaration_type == DECLARATION_FUNCTION) {
@@ -1701,7 +2410,8 @@ void print_declaration(declaration_t *dec) {
       if (0 < i) {
         eprintf(", ");
       }
-      eprintf("%.*s", dec->func_arg[i]->len, dec->func_arg[i]->str);
+      eprintf("%.*s", ident_len(dec->func_args[i]->name),
+              ident_str(dec->func_args[i]->name));
     }
     eprintf(") {\n");
     for (i = 0; i < dec->func_statement_count; ++i) {
@@ -1710,551 +2420,4645 @@ void print_declaration(declaration_t *dec) {
     }
     eprintf("}\n");
   } else if (dec->declaration_type == DECLARATION_TYPEDEF) {
-    eprintf("%.*s\n", dec->name->len, dec->name->str);
+    eprintf("%.*s\n", ident_len(dec->name), ident_str(dec->name));
   } else {
     error("failed to print declaration! type: %d", dec->declaration_type);
   }
 }
 
-char indent[1024];
+// assembly is accumulated in emit_buf and handed to write_output() in large
+// chunks. compact mode (--compact) drops indentation and comments.
+#define EMIT_BUFFER_SIZE 65536
+
+char *emit_buf;
+int emit_len;
+int emit_operand_count;  // operands written on the current line
+bool emit_compact = 0;
+bool emit_ir = 0;  // the IR of each function instead of assembly (--emit-ir)
+bool emit_ssa = 0;  // the same, in SSA form (--emit-ssa)
+
+const int REG_ZERO = 0;
+const int REG_RA = 1;
+const int REG_SP = 2;
+const int REG_T0 = 5;
+const int REG_T1 = 6;
+const int REG_T2 = 7;
+const int REG_S0 = 8;
+const int REG_S1 = 9;
+const int REG_A0 = 10;
+const int REG_S2 = 18;
+const int REG_S11 = 27;
+const int REG_T3 = 28;
+const int REG_T4 = 29;
+const int REG_T5 = 30;
+const int REG_T6 = 31;
+
+char *reg_names[32];
+
+void init_emitter() {
+  emit_buf = calloc(EMIT_BUFFER_SIZE, 1);
+  emit_len = 0;
+  reg_names[0] = "zero";
+  reg_names[1] = "ra";
+  reg_names[2] = "sp";
+  reg_names[3] = "gp";
+  reg_names[4] = "tp";
+  reg_names[5] = "t0";
+  reg_names[6] = "t1";
+  reg_names[7] = "t2";
+  reg_names[8] = "s0";
+  reg_names[9] = "s1";
+  reg_names[10] = "a0";
+  reg_names[11] = "a1";
+  reg_names[12] = "a2";
+  reg_names[13] = "a3";
+  reg_names[14] = "a4";
+  reg_names[15] = "a5";
+  reg_names[16] = "a6";
+  reg_names[17] = "a7";
+  reg_names[18] = "s2";
+  reg_names[19] = "s3";
+  reg_names[20] = "s4";
+  reg_names[21] = "s5";
+  reg_names[22] = "s6";
+  reg_names[23] = "s7";
+  reg_names[24] = "s8";
+  reg_names[25] = "s9";
+  reg_names[26] = "s10";
+  reg_names[27] = "s11";
+  reg_names[28] = "t3";
+  reg_names[29] = "t4";
+  reg_names[30] = "t5";
+  reg_names[31] = "t6";
+}
+
+void emit_flush() {
+  write_output(emit_buf, emit_len);
+  emit_len = 0;
+}
+
+void emit_strn(char *s, int len) {
+  if (EMIT_BUFFER_SIZE < emit_len + len) {
+    emit_flush();
+  }
+  if (EMIT_BUFFER_SIZE < len) {
+    write_output(s, len);
+    return;
+  }
+  memcpy(emit_buf + emit_len, s, len);
+  emit_len = emit_len + len;
+}
+
+void emit_str(char *s) { emit_strn(s, strlen(s)); }
+
+void emit_char(char c) {
+  if (emit_len == EMIT_BUFFER_SIZE) {
+    emit_flush();
+  }
+  emit_buf[emit_len] = c;
+  ++emit_len;
+}
+
+void emit_int(int n) {
+  char digits[12];
+  int i = 0;
+  int sign = 1;  // n is not negated, which would overflow for INT_MIN
+  if (n < 0) {
+    emit_char('-');
+    sign = -1;
+  }
+  for (;;) {
+    digits[i] = '0' + sign * (n % 10);
+    ++i;
+    n = n / 10;
+    if (n == 0) {
+      break;
+    }
+  }
+  while (0 < i) {
+    --i;
+    emit_char(digits[i]);
+  }
+}
+
+void emit_ident(int name) { emit_strn(ident_str(name), ident_len(name)); }
+
+void emit_eol() { emit_char('\n'); }
+
+void emit_comment(char *s) {
+  if (!emit_compact) {
+    emit_strn("\t# ", 3);
+    emit_str(s);
+  }
+}
+
+void emit_comment_ident(char *s, int name) {
+  if (!emit_compact) {
+    emit_strn("\t# ", 3);
+    emit_str(s);
+    emit_ident(name);
+  }
+}
+
+// starts a directive line, e.g. ".text"
+void emit_directive(char *s) {
+  if (!emit_compact) {
+    emit_strn("  ", 2);
+  }
+  emit_str(s);
+}
+
+// a label line, e.g. ".L.else3:"
+void emit_label(char *prefix, int index, char *comment) {
+  emit_str(prefix);
+  emit_int(index);
+  emit_char(':');
+  if (comment) {
+    emit_comment(comment);
+  }
+  emit_eol();
+}
+
+// deeper nesting is indented as deep as MAX_INDENT_DEPTH
+#define INDENT_SIZE 1024
+const int MAX_INDENT_DEPTH = 255;
+char indent[INDENT_SIZE];
 int depth;
 
 void update_indent() {
   int i;
-  for (i = 0; i < 4 * depth; i = i + 4) {
+  int n = depth;
+  if (MAX_INDENT_DEPTH < n) {
+    n = MAX_INDENT_DEPTH;
+  }
+  for (i = 0; i < 4 * n; i = i + 4) {
     indent[i] = indent[i + 1] = indent[i + 2] = indent[i + 3] = ' ';
   }
-  indent[4 * depth] = '\0';
+  indent[4 * n] = '\0';
 }
 void inc_depth() {
   ++depth;
-  update_indent();
+  if (!emit_compact) {
+    update_indent();
+  }
 }
 void dec_depth() {
   --depth;
-  update_indent();
+  if (!emit_compact) {
+    update_indent();
+  }
 }
-void print_indent() { printf("%s", indent); }
 
-void gen_pop(char *dst) {
-  printf("%slw %s, 0(sp)          # pop\n", indent, dst);
-  printf("%saddi sp, sp, +4       #  %s\n", indent, dst);
+// starts an instruction line with its mnemonic. operands follow.
+void emit_insn(char *op) {
+  if (!emit_compact) {
+    emit_str(indent);
+  }
+  emit_str(op);
+  emit_operand_count = 0;
 }
 
-void gen_push(char *src) {
-  printf("%saddi sp, sp, -4       # push\n", indent);
-  printf("%ssw %s, 0(sp)          #  %s\n", indent, src, src);
+void emit_operand_separator() {
+  if (emit_operand_count == 0) {
+    emit_char(' ');
+  } else {
+    emit_strn(", ", 2);
+  }
+  ++emit_operand_count;
 }
 
-void gen(node_t *node);
+void emit_reg(int reg) {
+  emit_operand_separator();
+  emit_str(reg_names[reg]);
+}
 
-void gen_lval(node_t *node) {
-  if (node->kind == NODE_LOCAL_VARIABLE) {
-    // local variable address
-    printf("%saddi t0, fp, %d\t\t# local variable: ", indent, node->offset);
-    printf("%.*s", node->name->len, node->name->str);
-    printf("\n");
-    gen_push("t0");
-  } else if (node->kind == NODE_GLOBAL_VARIABLE) {
-    // global variable address
-    printf("%slui t0, %%hi(%.*s)\n", indent, node->name->len, node->name->str);
-    printf("%saddi t0, t0, %%lo(%.*s)\n", indent, node->name->len,
-           node->name->str);
-    gen_push("t0");
-  } else if (node->kind == NODE_DEREF) {
-    gen(node->rhs);
-  } else if (node->kind == NODE_DOT) {
-    gen_lval(node->lhs);
-    gen_pop("t0");
-    if (node->rhs->offset < 2048) {
-      printf("%saddi t0, t0, %d\t\t# member: %.*s\n", indent, node->rhs->offset,
-             node->rhs->name->len, node->rhs->name->str);
-    } else {
-      printf("%sli t1, %d\t\t# member: %.*s\n", indent, node->rhs->offset,
-             node->rhs->name->len, node->rhs->name->str);
-      printf("%sadd t0, t0, t1\t\t# member: %.*s\n", indent,
-             node->rhs->name->len, node->rhs->name->str);
-    }
-    gen_push("t0");
-  } else if (node->kind == NODE_ARROW) {
-    gen(node->lhs);
-    gen_pop("t0");
-    if (node->rhs->offset < 2048) {
-      printf("%saddi t0, t0, %d\t\t# member: %.*s\n", indent, node->rhs->offset,
-             node->rhs->name->len, node->rhs->name->str);
-    } else {
-      printf("%sli t1, %d\t\t# member: %.*s\n", indent, node->rhs->offset,
-             node->rhs->name->len, node->rhs->name->str);
-      printf("%sadd t0, t0, t1\t\t# member: %.*s\n", indent,
-             node->rhs->name->len, node->rhs->name->str);
-    }
-    gen_push("t0");
+void emit_imm(int n) {
+  emit_operand_separator();
+  emit_int(n);
+}
+
+// offset(base)
+void emit_mem(int offset, int base) {
+  emit_operand_separator();
+  emit_int(offset);
+  emit_char('(');
+  emit_str(reg_names[base]);
+  emit_char(')');
+}
+
+void emit_label_ref(char *prefix, int index) {
+  emit_operand_separator();
+  emit_str(prefix);
+  emit_int(index);
+}
+
+// loads and stores: op reg, offset(base)
+void emit_rm(char *op, int reg, int offset, int base) {
+  emit_insn(op);
+  emit_reg(reg);
+  emit_mem(offset, base);
+  emit_eol();
+}
+
+// %hi(symbol) or %lo(symbol), where the symbol is either the identifier
+// `name` or the local label prefix + index
+void emit_reloc(char *reloc, char *prefix, int index, int name) {
+  emit_operand_separator();
+  emit_str(reloc);
+  emit_char('(');
+  if (name) {
+    emit_ident(name);
   } else {
-    error("左辺値が左辺値ではない！ kind=%d", node->kind);
+    emit_str(prefix);
+    emit_int(index);
   }
+  emit_char(')');
 }
 
-void gen_alloc_stack(local_variable_t *lvar) {
-  size_t bytes = calc_total_local_variable_size_on_stack(lvar);
-  printf("%saddi sp, sp, -%zd\t\t# stack alloc %zd B\n", indent, bytes, bytes);
+void emit_load_address(int rd, char *prefix, int index, int name) {
+  emit_insn("lui");
+  emit_reg(rd);
+  emit_reloc("%hi", prefix, index, name);
+  emit_eol();
+  emit_insn("addi");
+  emit_reg(rd);
+  emit_reg(rd);
+  emit_reloc("%lo", prefix, index, name);
+  emit_eol();
 }
 
-void gen_free_stack(local_variable_t *lvar) {
-  size_t bytes = calc_total_local_variable_size_on_stack(lvar);
-  printf("%saddi sp, sp, %zd\t\t# stack free %zd B\n", indent, bytes, bytes);
+// addi sp, sp, n, which allocates the frame when n is negative
+void emit_move_sp(int n, char *comment) {
+  emit_insn("addi");
+  emit_reg(REG_SP);
+  emit_reg(REG_SP);
+  emit_imm(n);
+  emit_comment(comment);
+  emit_eol();
 }
 
-void gen(node_t *node) {
-  int i;
-  char s[3];
+// the code of a function is collected in insns[] with virtual registers
+// (VREG_BASE and above) and mapped to physical registers or stack slots by
+// allocate_registers() before it is emitted
+const int INSN_LABEL = 1;   // prefix index:
+const int INSN_RRR = 2;     // op rd, rs1, rs2
+const int INSN_RRI = 3;     // op rd, rs1, imm
+const int INSN_RR = 4;      // op rd, rs1
+const int INSN_RI = 5;      // op rd, imm
+const int INSN_LOAD = 6;    // op rd, imm(rs1)
+const int INSN_STORE = 7;   // op rs2, imm(rs1)
+const int INSN_BRANCH = 8;  // op rs1, rs2, prefix index (rs2 0 for beqz...)
+const int INSN_JUMP = 9;    // j prefix index
+const int INSN_LA = 10;     // rd = address of name or prefix index
+const int INSN_CALL = 11;   // call name, with imm arguments on the stack
+const int INSN_RET = 12;    // tears down the frame and returns
+const int INSN_TAIL = 13;   // tears down the frame and jumps to name
+#define INSN_FORM_COUNT 14
+
+const int VREG_BASE = 32;
+
+struct insn_t {
+  int form;
+  char *op;
+  int rd;
+  int rs1;
+  int rs2;
+  int imm;
+  char *prefix;  // label
   int index;
-  int old_loop_label_index;
-  char *name;
+  int name;  // symbol
+  char *comment;
+  int comment_name;
+  int depth;  // for indentation
+};
+typedef struct insn_t insn_t;
 
-  inc_depth();
-  print_node(node);
-  eprintf("\n");
+insn_t *insns;
+int insn_count;
+int insn_capacity;
+int vreg_count;
+int variable_vreg_count;  // the first ones, holding local variables
 
-  if (node->kind == NODE_NUM) {
-    printf("%sli t0, %d\n", indent, node->val);
-    gen_push("t0");
-  } else if (node->kind == NODE_CONST_STRING) {
-    printf("%slui t0, %%hi(.L.C%zd)\n", indent, node->const_str->id);
-    printf("%saddi t0, t0, %%lo(.L.C%zd)\n", indent, node->const_str->id);
-    gen_push("t0");
-  } else if (node->kind == NODE_MINUS) {
-    gen(node->rhs);
-    gen_pop("t0");
-    printf("%ssub t0, zero, t0\n", indent);
-    gen_push("t0");
-  } else if (node->kind == NODE_ADD) {
-    gen(node->lhs);
-    gen(node->rhs);
-    gen_pop("t0");  // rhs
-    gen_pop("t1");  // lhs
-    if (node->lhs->type->ty == TYPE_POINTER ||
-        node->lhs->type->ty == TYPE_ARRAY) {
-      printf("%sli t2, %zd\n", indent,
-             calc_size_of_type(node->lhs->type->ptr_to));
-      printf("%smul t0, t0, t2\n", indent);
-    } else if (node->rhs->type->ty == TYPE_POINTER ||
-               node->rhs->type->ty == TYPE_ARRAY) {
-      printf("%sli t2, %zd\n", indent,
-             calc_size_of_type(node->lhs->type->ptr_to));
-      printf("%smul t1, t1, t2\n", indent);
-    }
-    printf("%sadd t0, t1, t0\n", indent);
-    gen_push("t0");
-  } else if (node->kind == NODE_SUB) {
-    gen(node->lhs);
-    gen(node->rhs);
-    gen_pop("t0");
-    gen_pop("t1");
-    if (node->lhs->type->ty == TYPE_POINTER ||
-        node->lhs->type->ty == TYPE_ARRAY) {
-      printf("%sslli t0, t0, 2\n", indent);  // rhs * 4
-    } else if (node->rhs->type->ty == TYPE_POINTER ||
-               node->rhs->type->ty == TYPE_ARRAY) {
-      printf("%sslli t1, t1, 2\n", indent);  // lhs * 4
-    }
-    printf("%ssub t0, t1, t0\n", indent);
-    gen_push("t0");
-  } else if (node->kind == NODE_MUL) {
-    gen(node->lhs);
-    gen(node->rhs);
-    gen_pop("t0");
-    gen_pop("t1");
-    printf("%smul t0, t1, t0\n", indent);
-    gen_push("t0");
-  } else if (node->kind == NODE_DIV) {
-    gen(node->lhs);
-    gen(node->rhs);
-    gen_pop("t0");
-    gen_pop("t1");
-    printf("%sdiv t0, t1, t0\n", indent);
-    gen_push("t0");
-  } else if (node->kind == NODE_MOD) {
-    gen(node->lhs);
-    gen(node->rhs);
-    gen_pop("t0");
-    gen_pop("t1");
-    printf("%srem t0, t1, t0\n", indent);
-    gen_push("t0");
-  } else if (node->kind == NODE_LT) {
-    gen(node->lhs);
-    gen(node->rhs);
-    gen_pop("t0");
-    gen_pop("t1");
-    printf("%sslt t0, t1, t0\n", indent);
-    gen_push("t0");
-  } else if (node->kind == NODE_LE) {
-    gen(node->lhs);
-    gen(node->rhs);
-    gen_pop("t0");
-    gen_pop("t1");
-    printf("%sslt t2, t1, t0\n", indent);  // t2 <- t1 < t0
-    printf("%ssub t3, t0, t1\n", indent);  // t3 <- t0 - t1
-    printf("%ssnez t3, t3\n",
-           indent);  // t3 <- t3 != 0 : a == b -> 0, a != b -> 1
-    printf("%sneg  t3, t3\n", indent);     // t3 <- a == b -> 0, a != b -> -1
-    printf("%saddi t3, t3, 1\n", indent);  // t3 <- a == b -> 1, a != b -> 0
-    printf("%sor   t0, t2, t3\n", indent);
-    gen_push("t0");
-  } else if (node->kind == NODE_GT) {
-    gen(node->lhs);
-    gen(node->rhs);
-    gen_pop("t0");
-    gen_pop("t1");
-    printf("%ssgt t0, t1, t0\n", indent);
-    gen_push("t0");
-  } else if (node->kind == NODE_GE) {
-    gen(node->lhs);
-    gen(node->rhs);
-    gen_pop("t0");
-    gen_pop("t1");
-    printf("%sslt t2, t0, t1\n", indent);  // t2 <- t0 < t1
-    printf("%ssub t3, t1, t0\n", indent);  // t3 <- t1 - t0
-    printf("%ssnez t3, t3\n",
-           indent);  // t3 <- t3 != 0 : a == b -> 0, a != b -> 1
-    printf("%sneg  t3, t3\n", indent);     // t3 <- a == b -> 0, a != b -> -1
-    printf("%saddi t3, t3, 1\n", indent);  // t3 <- a == b -> 1, a != b -> 0
-    printf("%sor   t0, t2, t3\n", indent);
-    gen_push("t0");
-  } else if (node->kind == NODE_LOGICAL_AND) {
-    index = gen_label_index();
-    gen(node->lhs);
-    gen_pop("t0");
-    printf("%sbeqz t0, .L.and.end.%d\t# logical and 1\n", indent, index);
-    gen(node->rhs);
-    gen_pop("t0");
-    printf(".L.and.end.%d:\n", index);
-    gen_push("t0");
-  } else if (node->kind == NODE_LOGICAL_OR) {
-    index = gen_label_index();
-    gen(node->lhs);
-    gen_pop("t0");
-    printf("%sbnez t0, .L.or.end.%d\t# logical or 1\n", indent, index);
-    gen(node->rhs);
-    gen_pop("t0");
-    printf(".L.or.end.%d:\n", index);
-    gen_push("t0");
-  } else if (node->kind == NODE_LOGICAL_NOT) {
-    gen(node->rhs);
-    gen_pop("t0");
-    printf("%sseqz t0, t0\n", indent);
-    gen_push("t0");
-  } else if (node->kind == NODE_EQ) {
-    gen(node->lhs);
-    gen(node->rhs);
-    gen_pop("t0");
-    gen_pop("t1");
-    printf("%sslt t2, t1, t0\n", indent);  // a < b
-    printf("%sslt t3, t0, t1\n", indent);  // a > b
-    printf("%sor  t1, t2, t3\n",
-           indent);  // (a < b) | (a > b) : a==b-> 0, a!=b->1
-    printf("%sli  t0, 1\n", indent);
-    printf("%ssub t0, t0, t1\n", indent);
-    gen_push("t0");
-  } else if (node->kind == NODE_NEQ) {
-    gen(node->lhs);
-    gen(node->rhs);
-    gen_pop("t0");
-    gen_pop("t1");
-    printf("%ssub t0, t1, t0\n", indent);
-    printf("%ssnez t0, t0\n", indent);
-    gen_push("t0");
-  } else if (node->kind == NODE_BITWISE_AND) {
-    gen(node->lhs);
-    gen(node->rhs);
-    gen_pop("t0");  // rhs
-    gen_pop("t1");  // lhs
-    printf("%sand t0, t1, t0\n", indent);
-    gen_push("t0");
-  } else if (node->kind == NODE_BITWISE_XOR) {
-    gen(node->lhs);
-    gen(node->rhs);
-    gen_pop("t0");  // rhs
-    gen_pop("t1");  // lhs
-    printf("%sxor t0, t1, t0\n", indent);
-    gen_push("t0");
-  } else if (node->kind == NODE_BITWISE_OR) {
-    gen(node->lhs);
-    gen(node->rhs);
-    gen_pop("t0");  // rhs
-    gen_pop("t1");  // lhs
-    printf("%sor t0, t1, t0\n", indent);
-    gen_push("t0");
-  } else if (node->kind == NODE_LOCAL_VARIABLE) {
-    gen_lval(node);
-    if (node->type->ty != TYPE_ARRAY) {
-      gen_pop("t0");
-      if (calc_size_of_type(node->type) == 4) {
-        printf("%slw t0, 0(t0)\n", indent);
-      } else if (calc_size_of_type(node->type) == 1) {
-        printf("%slb t0, 0(t0)\n", indent);
-      } else {
-        error("invalid size of type: %zd\n", calc_size_of_type(node->type));
-      }
-      gen_push("t0");
-    }
-  } else if (node->kind == NODE_GLOBAL_VARIABLE) {
-    gen_lval(node);
-    if (node->type->ty != TYPE_ARRAY) {
-      gen_pop("t0");
-      if (calc_size_of_type(node->type) == 4) {
-        printf("%slw t0, 0(t0)\n", indent);
-      } else if (calc_size_of_type(node->type) == 1) {
-        printf("%slb t0, 0(t0)\n", indent);
-      } else {
-        error("invalid size of type: %zd\n", calc_size_of_type(node->type));
-      }
-      gen_push("t0");
-    }
-  } else if (node->kind == NODE_DOT) {
-    gen_lval(node->lhs);
-    gen_pop("t0");
-    if (node->type->ty != TYPE_ARRAY) {
-      if (node->rhs->offset < 2048) {
-        printf("%slw t0, %d(t0)\n", indent, node->rhs->offset);
-      } else {
-        printf("%sli  t1, %d\n", indent, node->rhs->offset);
-        printf("%sadd t0, t0, t1\n", indent);
-        printf("%slw t0, 0(t0)\n", indent);
-      }
-    } else {
-      if (node->rhs->offset < 2048) {
-        printf("%saddi t0, t0, %d\n", indent, node->rhs->offset);
-      } else {
-        printf("%sli  t1, %d\n", indent, node->rhs->offset);
-        printf("%sadd t0, t0, t1\n", indent);
-      }
+int new_vreg() {
+  ++vreg_count;
+  return VREG_BASE + vreg_count - 1;
+}
+
+insn_t *new_insn(int form, char *op) {
+  insn_t *insn;
+  if (insn_count == insn_capacity) {
+    insns = arena_grow(function_arena, insns, insn_capacity * sizeof(insn_t),
+                       (insn_capacity * 2 + 256) * sizeof(insn_t));
+    insn_capacity = insn_capacity * 2 + 256;
+  }
+  insn = insns + insn_count;
+  ++insn_count;
+  insn->form = form;
+  insn->op = op;
+  insn->depth = depth;
+  return insn;
+}
+
+void insn_rrr(char *op, int rd, int rs1, int rs2) {
+  insn_t *insn = new_insn(INSN_RRR, op);
+  insn->rd = rd;
+  insn->rs1 = rs1;
+  insn->rs2 = rs2;
+}
+
+void insn_rri(char *op, int rd, int rs1, int imm) {
+  insn_t *insn = new_insn(INSN_RRI, op);
+  insn->rd = rd;
+  insn->rs1 = rs1;
+  insn->imm = imm;
+}
+
+void insn_rr(char *op, int rd, int rs1) {
+  insn_t *insn = new_insn(INSN_RR, op);
+  insn->rd = rd;
+  insn->rs1 = rs1;
+}
+
+void insn_ri(char *op, int rd, int imm) {
+  insn_t *insn = new_insn(INSN_RI, op);
+  insn->rd = rd;
+  insn->imm = imm;
+}
+
+void insn_load(char *op, int rd, int offset, int base) {
+  insn_t *insn = new_insn(INSN_LOAD, op);
+  insn->rd = rd;
+  insn->rs1 = base;
+  insn->imm = offset;
+}
+
+void insn_store(char *op, int rs, int offset, int base) {
+  insn_t *insn = new_insn(INSN_STORE, op);
+  insn->rs2 = rs;
+  insn->rs1 = base;
+  insn->imm = offset;
+}
+
+void insn_branch(char *op, int rs1, int rs2, char *prefix, int index) {
+  insn_t *insn = new_insn(INSN_BRANCH, op);
+  insn->rs1 = rs1;
+  insn->rs2 = rs2;
+  insn->prefix = prefix;
+  insn->index = index;
+}
+
+void insn_jump(char *prefix, int index) {
+  insn_t *insn = new_insn(INSN_JUMP, "j");
+  insn->prefix = prefix;
+  insn->index = index;
+}
+
+void insn_label(char *prefix, int index, char *comment) {
+  insn_t *insn = new_insn(INSN_LABEL, NULL);
+  insn->prefix = prefix;
+  insn->index = index;
+  insn->comment = comment;
+}
+
+void insn_load_address(int rd, char *prefix, int index, int name) {
+  insn_t *insn = new_insn(INSN_LA, NULL);
+  insn->rd = rd;
+  insn->prefix = prefix;
+  insn->index = index;
+  insn->name = name;
+}
+
+// comments the last instruction
+void insn_comment(char *s, int name) {
+  insn_t *insn = insns + (insn_count - 1);
+  insn->comment = s;
+  insn->comment_name = name;
+}
+
+// the register written by an instruction, if any
+int insn_def(insn_t *insn) {
+  int form = insn->form;
+  if (form == INSN_RRR || form == INSN_RRI || form == INSN_RR ||
+      form == INSN_RI || form == INSN_LOAD || form == INSN_LA) {
+    return insn->rd;
+  }
+  return 0;
+}
+
+// the registers read by an instruction; 0 (zero) if there is none
+int insn_use1(insn_t *insn) {
+  int form = insn->form;
+  if (form == INSN_RRR || form == INSN_RRI || form == INSN_RR ||
+      form == INSN_LOAD || form == INSN_STORE || form == INSN_BRANCH) {
+    return insn->rs1;
+  }
+  return 0;
+}
+
+int insn_use2(insn_t *insn) {
+  if (insn->form == INSN_RRR || insn->form == INSN_STORE ||
+      insn->form == INSN_BRANCH) {
+    return insn->rs2;
+  }
+  return 0;
+}
+
+// linear scan register allocation. a virtual register lives from its first
+// to its last mention in insns[] (its interval), stretched to the end of
+// any loop it is live into. intervals that cross a call get callee-saved
+// registers; when no register is left, the interval that ends last is kept
+// in a stack slot and reloaded through t5/t6 around every mention.
+#define ALLOC_REG_COUNT 17
+
+int alloc_regs[ALLOC_REG_COUNT];  // caller-saved ones first
+const int ALLOC_FIRST_CALLEE_SAVED = 5;
+bool reg_free[32];
+
+// indexed by vreg - VREG_BASE
+int *vreg_start;
+int *vreg_end;
+int *vreg_reg;    // physical register, 0 if spilled
+int *vreg_slot;   // frame offset of the stack slot of a spilled register
+int *vreg_order;  // by start
+int vreg_order_count;
+
+// the frame, from sp up: the stack arguments of the calls the function
+// makes, frame_size bytes of locals, stack slots and saved registers at
+// frame offsets from sp + frame_out_area, then the saved ra. it is
+// allocated once in the prologue and keeps sp 16-byte aligned, so sp does
+// not move in the body and no frame pointer is needed. a leaf does not
+// save ra, and one that needs nothing of the frame has none
+int locals_size;  // of the local variables in memory, set by promote_locals()
+int frame_size;
+int saved_reg_offset[32];  // frame offset of a used callee-saved register,
+                           // or -1
+int frame_out_area;  // set by select_insns()
+int frame_total;     // 16-byte aligned, 0 for no frame
+bool frame_saves_ra;
+
+void init_allocator() {
+  int i;
+  alloc_regs[0] = REG_T0;
+  alloc_regs[1] = REG_T1;
+  alloc_regs[2] = REG_T2;
+  alloc_regs[3] = REG_T3;
+  alloc_regs[4] = REG_T4;
+  alloc_regs[ALLOC_FIRST_CALLEE_SAVED] = REG_S0;
+  alloc_regs[ALLOC_FIRST_CALLEE_SAVED + 1] = REG_S1;
+  for (i = 0; i < 10; ++i) {
+    alloc_regs[ALLOC_FIRST_CALLEE_SAVED + 2 + i] = REG_S2 + i;
+  }
+  for (i = 0; i < 32; ++i) {
+    reg_free[i] = 1;
+  }
+}
+
+void touch_vreg(int reg, int pos) {
+  int v = reg - VREG_BASE;
+  if (reg < VREG_BASE) {
+    return;
+  }
+  if (vreg_start[v] < 0) {
+    vreg_start[v] = pos;
+    vreg_order[vreg_order_count] = v;
+    ++vreg_order_count;
+  }
+  vreg_end[v] = pos;
+}
+
+// position of the label a jump at `pos` goes back to, or -1 for a forward
+// jump
+int find_label_before(int pos, char *prefix, int index) {
+  insn_t *insn;
+  for (--pos; 0 <= pos; --pos) {
+    insn = insns + pos;
+    if (insn->form == INSN_LABEL && insn->index == index &&
+        strcmp(insn->prefix, prefix) == 0) {
+      return pos;
+    }
+  }
+  return -1;
+}
+
+bool is_callee_saved(int reg) {
+  return reg == REG_S0 || reg == REG_S1 || (REG_S2 <= reg && reg <= REG_S11);
+}
+
+void spill_vreg(int v) {
+  vreg_reg[v] = 0;
+  vreg_slot[v] = frame_size;
+  frame_size = frame_size + 4;
+}
+
+void allocate_registers() {
+  int n = vreg_count;
+  int *calls_before =
+      arena_alloc(function_arena, (insn_count + 1) * sizeof(int));
+  int active[ALLOC_REG_COUNT];
+  int active_count = 0;
+  int first;
+  int victim;
+  int reg;
+  int i;
+  int j;
+  int p;
+  int q;
+  int v;
+  insn_t *insn;
+
+  vreg_start = arena_alloc(function_arena, (n + 1) * sizeof(int));
+  vreg_end = arena_alloc(function_arena, (n + 1) * sizeof(int));
+  vreg_reg = arena_alloc(function_arena, (n + 1) * sizeof(int));
+  vreg_slot = arena_alloc(function_arena, (n + 1) * sizeof(int));
+  vreg_order = arena_alloc(function_arena, (n + 1) * sizeof(int));
+  vreg_order_count = 0;
+  for (v = 0; v < n; ++v) {
+    vreg_start[v] = -1;
+  }
+  // a local variable is kept in its register for the whole function
+  for (v = 0; v < variable_vreg_count; ++v) {
+    touch_vreg(VREG_BASE + v, 0);
+  }
+
+  for (p = 0; p < insn_count; ++p) {
+    insn = insns + p;
+    calls_before[p + 1] = calls_before[p];
+    if (insn->form == INSN_CALL) {
+      ++calls_before[p + 1];
+    }
+    touch_vreg(insn_use1(insn), p);
+    touch_vreg(insn_use2(insn), p);
+    touch_vreg(insn_def(insn), p);
+  }
+
+  for (p = 0; p < insn_count; ++p) {
+    insn = insns + p;
+    if (insn->form != INSN_JUMP && insn->form != INSN_BRANCH) {
+      continue;
+    }
+    q = find_label_before(p, insn->prefix, insn->index);
+    if (q < 0) {
+      continue;
+    }
+    for (v = 0; v < n; ++v) {
+      if (vreg_start[v] < q && q <= vreg_end[v] && vreg_end[v] < p) {
+        vreg_end[v] = p;
+      }
+    }
+    // a variable mentioned in the loop may be read in the next iteration
+    // before it is written again
+    for (v = 0; v < variable_vreg_count; ++v) {
+      if (q <= vreg_end[v] && vreg_end[v] < p) {
+        vreg_end[v] = p;
+      }
+    }
+  }
+
+  frame_size = locals_size;
+  for (i = 0; i < 32; ++i) {
+    saved_reg_offset[i] = -1;
+  }
+  for (i = 0; i < vreg_order_count; ++i) {
+    v = vreg_order[i];
+    j = 0;
+    while (j < active_count) {
+      if (vreg_end[active[j]] <= vreg_start[v]) {
+        reg_free[vreg_reg[active[j]]] = 1;
+        --active_count;
+        active[j] = active[active_count];
+      } else {
+        ++j;
+      }
+    }
+
+    first = 0;
+    if (calls_before[vreg_start[v] + 1] < calls_before[vreg_end[v]]) {
+      first = ALLOC_FIRST_CALLEE_SAVED;
+    }
+    reg = 0;
+    for (j = first; j < ALLOC_REG_COUNT; ++j) {
+      if (reg_free[alloc_regs[j]]) {
+        reg = alloc_regs[j];
+        break;
+      }
+    }
+    if (!reg) {
+      victim = -1;
+      for (j = 0; j < active_count; ++j) {
+        if (first && !is_callee_saved(vreg_reg[active[j]])) {
+          continue;
+        }
+        if (victim < 0 || vreg_end[active[victim]] < vreg_end[active[j]]) {
+          victim = j;
+        }
+      }
+      if (victim < 0 || vreg_end[active[victim]] <= vreg_end[v]) {
+        spill_vreg(v);
+        continue;
+      }
+      reg = vreg_reg[active[victim]];
+      spill_vreg(active[victim]);
+      --active_count;
+      active[victim] = active[active_count];
+    }
+    vreg_reg[v] = reg;
+    reg_free[reg] = 0;
+    active[active_count] = v;
+    ++active_count;
+    if (is_callee_saved(reg) && saved_reg_offset[reg] < 0) {
+      saved_reg_offset[reg] = 0;
+    }
+  }
+  for (j = 0; j < active_count; ++j) {
+    reg_free[vreg_reg[active[j]]] = 1;
+  }
+
+  for (i = ALLOC_FIRST_CALLEE_SAVED; i < ALLOC_REG_COUNT; ++i) {
+    reg = alloc_regs[i];
+    if (saved_reg_offset[reg] == 0) {
+      saved_reg_offset[reg] = frame_size;
+      frame_size = frame_size + 4;
+    }
+  }
+}
+
+void layout_frame() {
+  int i;
+  insn_t *insn;
+  frame_saves_ra = 0;
+  for (i = 0; i < insn_count; ++i) {
+    insn = insns + i;
+    if (insn->form == INSN_CALL) {
+      frame_saves_ra = 1;
+    }
+  }
+  frame_total = frame_out_area + frame_size + 4 * frame_saves_ra;
+  frame_total = (frame_total + 15) / 16 * 16;
+}
+
+// the three-address intermediate representation between the AST and the
+// instructions. gen() lowers the typed AST of a function into basic blocks
+// of ir_t whose operands are virtual registers, and select_insns() turns
+// them into insns[]. the second operand of a binary op is imm when b is 0.
+const int IR_CONST = 1;        // dst = imm
+const int IR_PARAM = 2;        // dst = argument register imm
+const int IR_ADDR_LOCAL = 3;   // dst = address of the frame offset imm
+const int IR_ADDR_GLOBAL = 4;  // dst = &name
+const int IR_ADDR_STRING = 5;  // dst = &.L.C imm
+const int IR_MOV = 6;          // dst = a
+const int IR_NEG = 7;          // dst = -a
+const int IR_NOT = 8;          // dst = !a
+const int IR_SEXT8 = 9;        // dst = a sign extended from its low byte
+const int IR_ZEXT8 = 10;       // dst = a & 255
+const int IR_ADD = 11;         // dst = a op b
+const int IR_SUB = 12;
+const int IR_MUL = 13;
+const int IR_DIV = 14;
+const int IR_MOD = 15;
+const int IR_AND = 16;
+const int IR_OR = 17;
+const int IR_XOR = 18;
+const int IR_LT = 19;
+const int IR_LE = 20;
+const int IR_GT = 21;
+const int IR_GE = 22;
+const int IR_EQ = 23;
+const int IR_NE = 24;
+const int IR_LOAD = 25;   // dst = *(a + imm), size bytes
+const int IR_STORE = 26;  // *(a + imm) = b, size bytes
+const int IR_CALL = 27;   // dst = name(args)
+const int IR_JMP = 28;    // goto target
+const int IR_BR = 29;     // if (a imm b) goto target; else goto target_else
+                          // imm is IR_LT..IR_NE, b 0 compares with 0
+const int IR_RET = 30;    // return a, if a is not 0
+const int IR_PHI = 31;    // dst = args[i] when entered from preds[i]
+#define IR_OP_COUNT 32
+
+char *ir_names[IR_OP_COUNT];
+char *ir_insn_ops[IR_OP_COUNT];  // of a binary op on two registers
+char *ir_branch_ops[IR_OP_COUNT];  // of a comparison, branching on it
+char *ir_branch_zero_ops[IR_OP_COUNT];  // the same, comparing with 0
+int ir_negated[IR_OP_COUNT];  // the comparison that is true when op is not
+char *ir_zero_test_ops[IR_OP_COUNT];  // seqz and snez for IR_EQ and IR_NE
+
+struct ir_t {
+  int op;
+  int dst;
+  int a;
+  int b;
+  int imm;
+  int size;  // of a load or store
+  int name;  // global variable or function
+  int *args;  // of a call or phi
+  int arg_count;
+  struct ir_block_t *target;
+  struct ir_block_t *target_else;
+  struct ir_t *next;
+  char *comment;
+  int comment_name;
+  int depth;  // for indentation
+  int id;     // numbering private to a pass
+  bool in_tree;  // computed in the tree of its user, see mark_trees()
+  bool tail;     // a call that returns for the function, and that return
+};
+typedef struct ir_t ir_t;
+
+struct ir_block_t {
+  int id;        // position in blocks[]
+  char *prefix;  // label, none for the entry block
+  int index;
+  char *comment;
+  ir_t *first;
+  ir_t *last;  // a terminator once the block is complete
+
+  // control flow graph, see build_cfg()
+  bool visited;
+  int rpo;  // position in reverse postorder
+  struct ir_block_t **preds;
+  int pred_count;
+  struct ir_block_t *idom;
+  struct ir_block_t *dom_child;    // first one it immediately dominates
+  struct ir_block_t *dom_sibling;  // next one its idom immediately dominates
+  int dom_pre;   // preorder and postorder numbers in the dominator tree
+  int dom_post;
+  struct ir_block_t **frontier;  // dominance frontier
+  int frontier_count;
+  int frontier_capacity;
+  int phi_mark;  // for construct_ssa()
+  int def_mark;
+};
+typedef struct ir_block_t ir_block_t;
+
+ir_block_t **blocks;  // of the current function, in layout order
+int block_count;
+int block_capacity;
+ir_block_t *cur_block;  // being filled, NULL after a terminator
+ir_block_t *break_block;
+ir_block_t *continue_block;
+
+void init_ir() {
+  ir_names[IR_CONST] = "const";
+  ir_names[IR_PARAM] = "param";
+  ir_names[IR_ADDR_LOCAL] = "local";
+  ir_names[IR_ADDR_GLOBAL] = "global";
+  ir_names[IR_ADDR_STRING] = "string";
+  ir_names[IR_MOV] = "mov";
+  ir_names[IR_NEG] = "neg";
+  ir_names[IR_NOT] = "not";
+  ir_names[IR_SEXT8] = "sext8";
+  ir_names[IR_ZEXT8] = "zext8";
+  ir_names[IR_ADD] = "add";
+  ir_names[IR_SUB] = "sub";
+  ir_names[IR_MUL] = "mul";
+  ir_names[IR_DIV] = "div";
+  ir_names[IR_MOD] = "mod";
+  ir_names[IR_AND] = "and";
+  ir_names[IR_OR] = "or";
+  ir_names[IR_XOR] = "xor";
+  ir_names[IR_LT] = "lt";
+  ir_names[IR_LE] = "le";
+  ir_names[IR_GT] = "gt";
+  ir_names[IR_GE] = "ge";
+  ir_names[IR_EQ] = "eq";
+  ir_names[IR_NE] = "ne";
+  ir_names[IR_LOAD] = "load";
+  ir_names[IR_STORE] = "store";
+  ir_names[IR_CALL] = "call";
+  ir_names[IR_JMP] = "jmp";
+  ir_names[IR_BR] = "br";
+  ir_names[IR_RET] = "ret";
+  ir_names[IR_PHI] = "phi";
+  ir_insn_ops[IR_ADD] = "add";
+  ir_insn_ops[IR_SUB] = "sub";
+  ir_insn_ops[IR_MUL] = "mul";
+  ir_insn_ops[IR_DIV] = "div";
+  ir_insn_ops[IR_MOD] = "rem";
+  ir_insn_ops[IR_AND] = "and";
+  ir_insn_ops[IR_OR] = "or";
+  ir_insn_ops[IR_XOR] = "xor";
+  ir_insn_ops[IR_LT] = "slt";
+  ir_insn_ops[IR_GT] = "sgt";
+  ir_branch_ops[IR_LT] = "blt";
+  ir_branch_ops[IR_LE] = "ble";
+  ir_branch_ops[IR_GT] = "bgt";
+  ir_branch_ops[IR_GE] = "bge";
+  ir_branch_ops[IR_EQ] = "beq";
+  ir_branch_ops[IR_NE] = "bne";
+  ir_branch_zero_ops[IR_LT] = "bltz";
+  ir_branch_zero_ops[IR_LE] = "blez";
+  ir_branch_zero_ops[IR_GT] = "bgtz";
+  ir_branch_zero_ops[IR_GE] = "bgez";
+  ir_branch_zero_ops[IR_EQ] = "beqz";
+  ir_branch_zero_ops[IR_NE] = "bnez";
+  ir_zero_test_ops[IR_EQ] = "seqz";
+  ir_zero_test_ops[IR_NE] = "snez";
+  ir_negated[IR_LT] = IR_GE;
+  ir_negated[IR_LE] = IR_GT;
+  ir_negated[IR_GT] = IR_LE;
+  ir_negated[IR_GE] = IR_LT;
+  ir_negated[IR_EQ] = IR_NE;
+  ir_negated[IR_NE] = IR_EQ;
+}
+
+ir_block_t *new_block(char *prefix, int index, char *comment) {
+  ir_block_t *block = arena_alloc(function_arena, sizeof(ir_block_t));
+  block->id = -1;
+  block->prefix = prefix;
+  block->index = index;
+  block->comment = comment;
+  return block;
+}
+
+void ir_jump(ir_block_t *target);
+
+// appends a block to the layout and fills it from now on. the current
+// block, if not yet terminated, falls through into it
+void start_block(ir_block_t *block) {
+  if (cur_block) {
+    ir_jump(block);
+  }
+  if (block_count == block_capacity) {
+    blocks = arena_grow(function_arena, blocks,
+                        block_capacity * sizeof(ir_block_t *),
+                        (block_capacity * 2 + 16) * sizeof(ir_block_t *));
+    block_capacity = block_capacity * 2 + 16;
+  }
+  block->id = block_count;
+  blocks[block_count] = block;
+  ++block_count;
+  cur_block = block;
+}
+
+// appends an instruction to the current block. code after a terminator is
+// unreachable and gets a block of its own
+ir_t *new_ir(int op) {
+  ir_t *ir;
+  if (!cur_block) {
+    start_block(new_block(".L.dead", gen_label_index(), NULL));
+  }
+  ir = arena_alloc(function_arena, sizeof(ir_t));
+  ir->op = op;
+  ir->depth = depth;
+  if (cur_block->last) {
+    cur_block->last->next = ir;
+  } else {
+    cur_block->first = ir;
+  }
+  cur_block->last = ir;
+  return ir;
+}
+
+// starts a new function at its entry block
+void reset_ir() {
+  blocks = NULL;
+  block_count = 0;
+  block_capacity = 0;
+  cur_block = NULL;
+  start_block(new_block(NULL, 0, NULL));
+}
+
+bool ir_is_terminator(int op) {
+  return op == IR_JMP || op == IR_BR || op == IR_RET;
+}
+
+bool ir_is_binary(int op) { return IR_ADD <= op && op <= IR_NE; }
+
+bool ir_is_unary(int op) { return IR_MOV <= op && op <= IR_ZEXT8; }
+
+int ir_const(int imm) {
+  ir_t *ir = new_ir(IR_CONST);
+  ir->dst = new_vreg();
+  ir->imm = imm;
+  return ir->dst;
+}
+
+// the address of a local variable, global variable or constant string
+int ir_address(int op, int imm, int name) {
+  ir_t *ir = new_ir(op);
+  ir->dst = new_vreg();
+  ir->imm = imm;
+  ir->name = name;
+  return ir->dst;
+}
+
+void ir_unary_to(int op, int dst, int a) {
+  ir_t *ir = new_ir(op);
+  ir->dst = dst;
+  ir->a = a;
+}
+
+int ir_unary(int op, int a) {
+  int dst = new_vreg();
+  ir_unary_to(op, dst, a);
+  return dst;
+}
+
+int ir_binary(int op, int a, int b) {
+  ir_t *ir = new_ir(op);
+  ir->dst = new_vreg();
+  ir->a = a;
+  ir->b = b;
+  return ir->dst;
+}
+
+int ir_binary_imm(int op, int a, int imm) {
+  ir_t *ir = new_ir(op);
+  ir->dst = new_vreg();
+  ir->a = a;
+  ir->imm = imm;
+  return ir->dst;
+}
+
+int ir_load(int size, int addr, int offset) {
+  ir_t *ir = new_ir(IR_LOAD);
+  ir->dst = new_vreg();
+  ir->a = addr;
+  ir->imm = offset;
+  ir->size = size;
+  return ir->dst;
+}
+
+void ir_store(int size, int value, int addr, int offset) {
+  ir_t *ir = new_ir(IR_STORE);
+  ir->a = addr;
+  ir->b = value;
+  ir->imm = offset;
+  ir->size = size;
+}
+
+void ir_jump(ir_block_t *target) {
+  ir_t *ir = new_ir(IR_JMP);
+  ir->target = target;
+  cur_block = NULL;
+}
+
+// branches on a op b, with b 0 for a comparison with 0
+void ir_compare_branch(int op, int a, int b, ir_block_t *then,
+                       ir_block_t *els) {
+  ir_t *ir = new_ir(IR_BR);
+  ir->a = a;
+  ir->b = b;
+  ir->imm = op;
+  ir->target = then;
+  ir->target_else = els;
+  cur_block = NULL;
+}
+
+void ir_branch(int cond, ir_block_t *then, ir_block_t *els) {
+  ir_compare_branch(IR_NE, cond, 0, then, els);
+}
+
+void ir_return(int value) {
+  ir_t *ir = new_ir(IR_RET);
+  ir->a = value;
+  cur_block = NULL;
+}
+
+// comments the last instruction
+void ir_comment(char *s, int name) {
+  cur_block->last->comment = s;
+  cur_block->last->comment_name = name;
+}
+
+// the vregs an instruction reads are its operands 0 .. count - 1
+int ir_operand_count(ir_t *ir) {
+  if (ir->op == IR_CALL || ir->op == IR_PHI) {
+    return ir->arg_count;
+  } else if (ir->b) {
+    return 2;
+  } else if (ir->a) {
+    return 1;
+  }
+  return 0;
+}
+
+// where operand i is kept, for passes that rewrite it
+int *ir_operand_slot(ir_t *ir, int i) {
+  if (ir->op == IR_CALL || ir->op == IR_PHI) {
+    return ir->args + i;
+  } else if (i == 0) {
+    return &ir->a;
+  }
+  return &ir->b;
+}
+
+int ir_operand(ir_t *ir, int i) {
+  int *slot = ir_operand_slot(ir, i);
+  return *slot;
+}
+
+void print_ir_vreg(int reg) {
+  emit_char('%');
+  emit_int(reg - VREG_BASE);
+}
+
+void print_ir_block_name(ir_block_t *block) {
+  if (block->prefix) {
+    emit_str(block->prefix);
+    emit_int(block->index);
+  } else {
+    emit_str("entry");
+  }
+}
+
+// one instruction per line, e.g. "%3 = add %1, 4" or "store.1 %2, 0, %3"
+void print_ir(ir_t *ir) {
+  int i;
+  emit_strn("  ", 2);
+  if (ir->dst) {
+    print_ir_vreg(ir->dst);
+    emit_strn(" = ", 3);
+  }
+  emit_str(ir_names[ir->op]);
+  if (ir->op == IR_LOAD || ir->op == IR_STORE) {
+    emit_char('.');
+    emit_int(ir->size);
+  }
+  emit_char(' ');
+  if (ir->op == IR_CONST || ir->op == IR_PARAM || ir->op == IR_ADDR_LOCAL ||
+      ir->op == IR_ADDR_STRING) {
+    emit_int(ir->imm);
+  } else if (ir->op == IR_ADDR_GLOBAL) {
+    emit_ident(ir->name);
+  } else if (ir->op == IR_CALL) {
+    emit_ident(ir->name);
+    emit_char('(');
+    for (i = 0; i < ir->arg_count; ++i) {
+      if (i) {
+        emit_strn(", ", 2);
+      }
+      print_ir_vreg(ir->args[i]);
+    }
+    emit_char(')');
+  } else if (ir->op == IR_PHI) {
+    for (i = 0; i < ir->arg_count; ++i) {
+      if (i) {
+        emit_strn(", ", 2);
+      }
+      emit_char('[');
+      print_ir_vreg(ir->args[i]);
+      emit_strn(", ", 2);
+      print_ir_block_name(cur_block->preds[i]);
+      emit_char(']');
+    }
+  } else if (ir->op == IR_JMP) {
+    print_ir_block_name(ir->target);
+  } else if (ir->op == IR_BR) {
+    if (ir->imm != IR_NE || ir->b) {
+      emit_str(ir_names[ir->imm]);
+      emit_char(' ');
+    }
+    print_ir_vreg(ir->a);
+    if (ir->b) {
+      emit_strn(", ", 2);
+      print_ir_vreg(ir->b);
+    } else if (ir->imm != IR_NE) {
+      emit_strn(", 0", 3);
+    }
+    emit_strn(", ", 2);
+    print_ir_block_name(ir->target);
+    emit_strn(", ", 2);
+    print_ir_block_name(ir->target_else);
+  } else if (ir->a) {
+    print_ir_vreg(ir->a);
+  }
+  if (ir_is_binary(ir->op) || ir->op == IR_LOAD || ir->op == IR_STORE) {
+    emit_strn(", ", 2);
+    if (ir->b && ir->op != IR_STORE) {
+      print_ir_vreg(ir->b);
+    } else {
+      emit_int(ir->imm);
+    }
+  }
+  if (ir->op == IR_STORE) {
+    emit_strn(", ", 2);
+    print_ir_vreg(ir->b);
+  }
+  emit_eol();
+}
+
+// the textual form of the current function, for --emit-ir
+void print_ir_function(int name) {
+  int i;
+  ir_t *ir;
+  emit_str("function ");
+  emit_ident(name);
+  emit_eol();
+  for (i = 0; i < block_count; ++i) {
+    print_ir_block_name(blocks[i]);
+    emit_char(':');
+    emit_eol();
+    cur_block = blocks[i];
+    for (ir = blocks[i]->first; ir; ir = ir->next) {
+      print_ir(ir);
+    }
+  }
+  cur_block = NULL;
+  emit_eol();
+}
+
+void verify_ir_vreg(int reg, char *what) {
+  if (reg < VREG_BASE || VREG_BASE + vreg_count <= reg) {
+    error("ir: %s %%%d is not a virtual register", what, reg - VREG_BASE);
+  }
+}
+
+void verify_ir_target(ir_block_t *target) {
+  if (!target || target->id < 0 || block_count <= target->id ||
+      blocks[target->id] != target) {
+    error("ir: branch to a block outside of the function");
+  }
+}
+
+// checks the shape the passes and instruction selection rely on: every
+// block ends in its only terminator, phis come first, branches stay in the
+// function and operands are virtual registers of the right kind
+void verify_ir() {
+  int i;
+  int j;
+  int n;
+  int op;
+  bool phis_allowed;
+  ir_t *ir;
+
+  for (i = 0; i < block_count; ++i) {
+    if (!blocks[i]->first) {
+      error("ir: block %d is empty", i);
+    }
+    phis_allowed = 1;
+    for (ir = blocks[i]->first; ir; ir = ir->next) {
+      op = ir->op;
+      if (op < IR_CONST || IR_PHI < op) {
+        error("ir: unknown op %d", op);
+      }
+      if (ir_is_terminator(op) != (ir == blocks[i]->last)) {
+        error("ir: block %d does not end in exactly one terminator", i);
+      }
+      if (op == IR_PHI && !phis_allowed) {
+        error("ir: phi after other instructions in block %d", i);
+      }
+      phis_allowed = op == IR_PHI;
+      if (op == IR_STORE || ir_is_terminator(op)) {
+        if (ir->dst) {
+          error("ir: %s has a result", ir_names[op]);
+        }
+      } else if (op != IR_CALL || ir->dst) {
+        verify_ir_vreg(ir->dst, "result");
+      }
+      if (ir_is_unary(op) || ir_is_binary(op) || op == IR_LOAD ||
+          op == IR_STORE || op == IR_BR) {
+        verify_ir_vreg(ir->a, "operand");
+      }
+      if (op == IR_STORE) {
+        verify_ir_vreg(ir->b, "operand");
+      }
+      n = ir_operand_count(ir);
+      for (j = 0; j < n; ++j) {
+        verify_ir_vreg(ir_operand(ir, j), "operand");
+      }
+      if ((op == IR_LOAD || op == IR_STORE) && ir->size != 1 &&
+          ir->size != 4) {
+        error("ir: %s of %d bytes", ir_names[op], ir->size);
+      }
+      if (op == IR_JMP || op == IR_BR) {
+        verify_ir_target(ir->target);
+      }
+      if (op == IR_BR) {
+        verify_ir_target(ir->target_else);
+        if (ir->imm < IR_LT || IR_NE < ir->imm) {
+          error("ir: br on %d", ir->imm);
+        }
+      }
+    }
+  }
+}
+
+// the control flow graph of the blocks. the successors of a block are the
+// targets of its terminator
+int block_succ_count(ir_block_t *block) {
+  if (block->last->op == IR_JMP) {
+    return 1;
+  } else if (block->last->op == IR_BR) {
+    return 2;
+  }
+  return 0;
+}
+
+ir_block_t *block_succ(ir_block_t *block, int i) {
+  if (i == 0) {
+    return block->last->target;
+  }
+  return block->last->target_else;
+}
+
+ir_block_t **rpo_blocks;  // in reverse postorder
+int rpo_count;
+
+void visit_block(ir_block_t *block) {
+  int i;
+  ir_block_t *succ;
+  block->visited = 1;
+  for (i = 0; i < block_succ_count(block); ++i) {
+    succ = block_succ(block, i);
+    if (!succ->visited) {
+      visit_block(succ);
+    }
+  }
+  rpo_blocks[rpo_count] = block;  // postorder for now
+  ++rpo_count;
+}
+
+// drops the blocks that cannot be reached from the entry, then orders the
+// rest and collects their predecessors
+void build_cfg() {
+  int i;
+  int j;
+  int n = 0;
+  ir_block_t *block;
+  ir_block_t *succ;
+
+  rpo_blocks = arena_alloc(function_arena, block_count * sizeof(ir_block_t *));
+  rpo_count = 0;
+  visit_block(blocks[0]);
+  for (i = 0; i < rpo_count / 2; ++i) {
+    block = rpo_blocks[i];
+    rpo_blocks[i] = rpo_blocks[rpo_count - 1 - i];
+    rpo_blocks[rpo_count - 1 - i] = block;
+  }
+  for (i = 0; i < rpo_count; ++i) {
+    rpo_blocks[i]->rpo = i;
+  }
+
+  for (i = 0; i < block_count; ++i) {
+    block = blocks[i];
+    if (block->visited) {
+      block->id = n;
+      blocks[n] = block;
+      ++n;
+    }
+  }
+  block_count = n;
+
+  for (i = 0; i < block_count; ++i) {
+    for (j = 0; j < block_succ_count(blocks[i]); ++j) {
+      succ = block_succ(blocks[i], j);
+      ++succ->pred_count;
+    }
+  }
+  for (i = 0; i < block_count; ++i) {
+    block = blocks[i];
+    block->preds =
+        arena_alloc(function_arena, block->pred_count * sizeof(ir_block_t *));
+    block->pred_count = 0;
+  }
+  for (i = 0; i < block_count; ++i) {
+    for (j = 0; j < block_succ_count(blocks[i]); ++j) {
+      succ = block_succ(blocks[i], j);
+      succ->preds[succ->pred_count] = blocks[i];
+      ++succ->pred_count;
+    }
+  }
+}
+
+// dominators by the iterative algorithm of Cooper, Harvey and Kennedy
+ir_block_t *intersect_dominators(ir_block_t *a, ir_block_t *b) {
+  while (a != b) {
+    while (b->rpo < a->rpo) {
+      a = a->idom;
+    }
+    while (a->rpo < b->rpo) {
+      b = b->idom;
+    }
+  }
+  return a;
+}
+
+int dom_counter;
+
+void number_dominator_tree(ir_block_t *block) {
+  ir_block_t *child;
+  block->dom_pre = dom_counter;
+  ++dom_counter;
+  for (child = block->dom_child; child; child = child->dom_sibling) {
+    number_dominator_tree(child);
+  }
+  block->dom_post = dom_counter;
+  ++dom_counter;
+}
+
+bool dominates(ir_block_t *a, ir_block_t *b) {
+  return a->dom_pre <= b->dom_pre && b->dom_post <= a->dom_post;
+}
+
+void add_frontier(ir_block_t *block, ir_block_t *member) {
+  if (block->frontier_count &&
+      block->frontier[block->frontier_count - 1] == member) {
+    return;
+  }
+  if (block->frontier_count == block->frontier_capacity) {
+    block->frontier = arena_grow(
+        function_arena, block->frontier,
+        block->frontier_capacity * sizeof(ir_block_t *),
+        (block->frontier_capacity * 2 + 4) * sizeof(ir_block_t *));
+    block->frontier_capacity = block->frontier_capacity * 2 + 4;
+  }
+  block->frontier[block->frontier_count] = member;
+  ++block->frontier_count;
+}
+
+// the dominator tree and the dominance frontier of every block
+void compute_dominators() {
+  bool changed = 1;
+  int i;
+  int j;
+  ir_block_t *block;
+  ir_block_t *pred;
+  ir_block_t *idom;
+  ir_block_t *runner;
+
+  rpo_blocks[0]->idom = rpo_blocks[0];
+  while (changed) {
+    changed = 0;
+    for (i = 1; i < rpo_count; ++i) {
+      block = rpo_blocks[i];
+      idom = NULL;
+      for (j = 0; j < block->pred_count; ++j) {
+        pred = block->preds[j];
+        if (!pred->idom) {
+          continue;
+        } else if (idom) {
+          idom = intersect_dominators(pred, idom);
+        } else {
+          idom = pred;
+        }
+      }
+      if (block->idom != idom) {
+        block->idom = idom;
+        changed = 1;
+      }
+    }
+  }
+
+  for (i = block_count - 1; 1 <= i; --i) {
+    block = blocks[i];
+    block->dom_sibling = block->idom->dom_child;
+    block->idom->dom_child = block;
+  }
+  dom_counter = 0;
+  number_dominator_tree(blocks[0]);
+
+  for (i = 0; i < block_count; ++i) {
+    block = blocks[i];
+    if (block->pred_count < 2) {
+      continue;
+    }
+    for (j = 0; j < block->pred_count; ++j) {
+      for (runner = block->preds[j]; runner != block->idom;
+           runner = runner->idom) {
+        add_frontier(runner, block);
+      }
+    }
+  }
+}
+
+// sets of small integers, 31 bits to an int since there are no shifts or
+// unsigned ints in the language compiled
+#define BITS_PER_WORD 31
+
+int bit_masks[BITS_PER_WORD];
+
+void init_bitsets() {
+  int i;
+  bit_masks[0] = 1;
+  for (i = 1; i < BITS_PER_WORD; ++i) {
+    bit_masks[i] = bit_masks[i - 1] * 2;
+  }
+}
+
+int *new_bitset(int words) {
+  return arena_alloc(function_arena, words * sizeof(int));
+}
+
+bool bit_test(int *set, int i) {
+  return (set[i / BITS_PER_WORD] & bit_masks[i % BITS_PER_WORD]) != 0;
+}
+
+void bit_set(int *set, int i) {
+  set[i / BITS_PER_WORD] =
+      set[i / BITS_PER_WORD] | bit_masks[i % BITS_PER_WORD];
+}
+
+void bit_clear(int *set, int i) {
+  if (bit_test(set, i)) {
+    set[i / BITS_PER_WORD] =
+        set[i / BITS_PER_WORD] - bit_masks[i % BITS_PER_WORD];
+  }
+}
+
+// a gen/kill problem on the blocks, solved by iterating to a fixpoint. a
+// forward problem flows from predecessors to successors, a backward one the
+// other way. per block, `in` is the union of what flows into it and
+// out = gen | (in & ~kill), so for a backward problem `in` holds at the end
+// of the block and `out` at its start.
+struct dataflow_t {
+  bool backward;
+  int words;  // per set
+  int **gen;  // by block id
+  int **kill;
+  int **in;
+  int **out;
+};
+typedef struct dataflow_t dataflow_t;
+
+int **new_bitsets(int words) {
+  int **sets = arena_alloc(function_arena, block_count * sizeof(int *));
+  int i;
+  for (i = 0; i < block_count; ++i) {
+    sets[i] = new_bitset(words);
+  }
+  return sets;
+}
+
+dataflow_t *new_dataflow(int bits, bool backward) {
+  dataflow_t *df = arena_alloc(function_arena, sizeof(dataflow_t));
+  df->backward = backward;
+  df->words = bits / BITS_PER_WORD + 1;
+  df->gen = new_bitsets(df->words);
+  df->kill = new_bitsets(df->words);
+  df->in = new_bitsets(df->words);
+  df->out = new_bitsets(df->words);
+  return df;
+}
+
+void union_into(int *dst, int *src, int words) {
+  int w;
+  for (w = 0; w < words; ++w) {
+    dst[w] = dst[w] | src[w];
+  }
+}
+
+void solve_dataflow(dataflow_t *df) {
+  bool changed = 1;
+  int i;
+  int j;
+  int w;
+  int word;
+  int id;
+  ir_block_t *block;
+  ir_block_t *pred;
+  ir_block_t *succ;
+
+  while (changed) {
+    changed = 0;
+    for (i = 0; i < rpo_count; ++i) {
+      if (df->backward) {
+        block = rpo_blocks[rpo_count - 1 - i];
+        for (j = 0; j < block_succ_count(block); ++j) {
+          succ = block_succ(block, j);
+          union_into(df->in[block->id], df->out[succ->id], df->words);
+        }
+      } else {
+        block = rpo_blocks[i];
+        for (j = 0; j < block->pred_count; ++j) {
+          pred = block->preds[j];
+          union_into(df->in[block->id], df->out[pred->id], df->words);
+        }
+      }
+      id = block->id;
+      for (w = 0; w < df->words; ++w) {
+        word = df->gen[id][w] |
+               (df->in[id][w] ^ (df->in[id][w] & df->kill[id][w]));
+        if (word != df->out[id][w]) {
+          df->out[id][w] = word;
+          changed = 1;
+        }
+      }
+    }
+  }
+}
+
+// the analyses below look at the vregs that may be written more than once:
+// local variables and temporaries with several definitions. a temporary
+// written once is already in SSA form. tracked_bit[] numbers the others
+// for the bit sets.
+int *tracked_bit;  // by vreg, -1 if not tracked
+int tracked_count;
+
+void choose_tracked_vregs() {
+  int *def_count = arena_alloc(function_arena, (vreg_count + 1) * sizeof(int));
+  int i;
+  int v;
+  ir_t *ir;
+  for (i = 0; i < block_count; ++i) {
+    for (ir = blocks[i]->first; ir; ir = ir->next) {
+      if (ir->dst) {
+        ++def_count[ir->dst - VREG_BASE];
+      }
+    }
+  }
+  tracked_bit = arena_alloc(function_arena, (vreg_count + 1) * sizeof(int));
+  tracked_count = 0;
+  for (v = 0; v < vreg_count; ++v) {
+    tracked_bit[v] = -1;
+    if (v < variable_vreg_count || 1 < def_count[v]) {
+      tracked_bit[v] = tracked_count;
+      ++tracked_count;
+    }
+  }
+}
+
+// live tracked vregs, a backward problem: a block reads gen before writing
+// it and writes kill. out is the set live at the start of a block. phis
+// are not looked at, so it is for code before SSA construction.
+dataflow_t *compute_liveness() {
+  dataflow_t *df = new_dataflow(tracked_count, 1);
+  int i;
+  int j;
+  int n;
+  int bit;
+  ir_t *ir;
+  for (i = 0; i < block_count; ++i) {
+    for (ir = blocks[i]->first; ir; ir = ir->next) {
+      n = ir_operand_count(ir);
+      for (j = 0; j < n; ++j) {
+        bit = tracked_bit[ir_operand(ir, j) - VREG_BASE];
+        if (0 <= bit && !bit_test(df->kill[i], bit)) {
+          bit_set(df->gen[i], bit);
+        }
+      }
+      if (ir->dst && 0 <= tracked_bit[ir->dst - VREG_BASE]) {
+        bit_set(df->kill[i], tracked_bit[ir->dst - VREG_BASE]);
+      }
+    }
+  }
+  solve_dataflow(df);
+  return df;
+}
+
+// definitions are the instructions writing a tracked vreg, numbered by
+// ir->id. def_sites[] holds them and next_def_site[] chains those of one
+// vreg from first_def_site[vreg]
+ir_t **def_sites;
+int def_site_count;
+int *def_site_block;  // by site: id of its block
+int *next_def_site;
+int *first_def_site;
+
+void number_definitions() {
+  int i;
+  ir_t *ir;
+  def_site_count = 0;
+  for (i = 0; i < block_count; ++i) {
+    for (ir = blocks[i]->first; ir; ir = ir->next) {
+      if (ir->dst && 0 <= tracked_bit[ir->dst - VREG_BASE]) {
+        ++def_site_count;
+      }
+    }
+  }
+  def_sites =
+      arena_alloc(function_arena, (def_site_count + 1) * sizeof(ir_t *));
+  def_site_block =
+      arena_alloc(function_arena, (def_site_count + 1) * sizeof(int));
+  next_def_site =
+      arena_alloc(function_arena, (def_site_count + 1) * sizeof(int));
+  first_def_site =
+      arena_alloc(function_arena, (vreg_count + 1) * sizeof(int));
+  for (i = 0; i < vreg_count; ++i) {
+    first_def_site[i] = -1;
+  }
+  def_site_count = 0;
+  for (i = block_count - 1; 0 <= i; --i) {
+    for (ir = blocks[i]->first; ir; ir = ir->next) {
+      if (ir->dst && 0 <= tracked_bit[ir->dst - VREG_BASE]) {
+        ir->id = def_site_count;
+        def_sites[def_site_count] = ir;
+        def_site_block[def_site_count] = i;
+        next_def_site[def_site_count] = first_def_site[ir->dst - VREG_BASE];
+        first_def_site[ir->dst - VREG_BASE] = def_site_count;
+        ++def_site_count;
+      }
+    }
+  }
+}
+
+// a definition of reg replaces all others in `set`
+void define_in(int *set, int reg, ir_t *ir) {
+  int site;
+  for (site = first_def_site[reg - VREG_BASE]; 0 <= site;
+       site = next_def_site[site]) {
+    bit_clear(set, site);
+  }
+  bit_set(set, ir->id);
+}
+
+// reaching definitions, a forward problem on the sites of
+// number_definitions(): a block generates its last definition of each vreg
+// and kills the other definitions of the vregs it writes
+dataflow_t *compute_reaching_definitions() {
+  dataflow_t *df;
+  int i;
+  int site;
+  ir_t *ir;
+  number_definitions();
+  df = new_dataflow(def_site_count, 0);
+  for (i = 0; i < block_count; ++i) {
+    for (ir = blocks[i]->first; ir; ir = ir->next) {
+      if (!ir->dst || tracked_bit[ir->dst - VREG_BASE] < 0) {
+        continue;
+      }
+      define_in(df->gen[i], ir->dst, ir);
+      for (site = first_def_site[ir->dst - VREG_BASE]; 0 <= site;
+           site = next_def_site[site]) {
+        bit_set(df->kill[i], site);
+      }
+    }
+  }
+  solve_dataflow(df);
+  return df;
+}
+
+// every read of a temporary written more than once is reached by a
+// definition of it. local variables may be read before they are written;
+// verify_ssa() checks the other temporaries
+void verify_definitions() {
+  dataflow_t *df = compute_reaching_definitions();
+  int *reaching = new_bitset(df->words);
+  int i;
+  int j;
+  int n;
+  int w;
+  int reg;
+  int site;
+  ir_t *ir;
+  for (i = 0; i < block_count; ++i) {
+    for (w = 0; w < df->words; ++w) {
+      reaching[w] = df->in[i][w];
+    }
+    for (ir = blocks[i]->first; ir; ir = ir->next) {
+      n = ir_operand_count(ir);
+      for (j = 0; j < n; ++j) {
+        reg = ir_operand(ir, j);
+        if (reg - VREG_BASE < variable_vreg_count ||
+            tracked_bit[reg - VREG_BASE] < 0) {
+          continue;
+        }
+        site = first_def_site[reg - VREG_BASE];
+        while (0 <= site && !bit_test(reaching, site)) {
+          site = next_def_site[site];
+        }
+        if (site < 0) {
+          error("ir: %%%d is read where it is not defined", reg - VREG_BASE);
+        }
+      }
+      if (ir->dst && 0 <= tracked_bit[ir->dst - VREG_BASE]) {
+        define_in(reaching, ir->dst, ir);
+      }
+    }
+  }
+}
+
+// SSA form. construct_ssa() renames every definition of a local variable,
+// or of a temporary written more than once, to a new vreg and joins them
+// with phis where control flow meets. passes keep the SSA conventional: the
+// versions of one vreg never overlap, so destruct_ssa() can give every
+// version its original vreg back.
+int ssa_base;       // vreg_count before renaming
+int *ssa_origin;    // by vreg: the one it is a version of
+int *ssa_current;   // by vreg: its version at this point of the renaming
+int *rename_log;    // (vreg, previous version) pairs to undo
+int rename_log_count;
+int undef_reg;      // 0, read in place of an undefined variable
+
+void set_ssa_version(int reg, int version) {
+  rename_log[rename_log_count] = reg;
+  rename_log[rename_log_count + 1] = ssa_current[reg - VREG_BASE];
+  rename_log_count = rename_log_count + 2;
+  ssa_current[reg - VREG_BASE] = version;
+}
+
+void rename_use(int *operand) {
+  int v = *operand - VREG_BASE;
+  if (tracked_bit[v] < 0) {
+    return;
+  }
+  if (ssa_current[v]) {
+    *operand = ssa_current[v];
+  } else {
+    *operand = undef_reg;
+  }
+}
+
+// renames the definitions of a block and the uses they reach in the blocks
+// it dominates
+void rename_block(ir_block_t *block) {
+  int mark = rename_log_count;
+  int i;
+  int j;
+  int n;
+  int reg;
+  ir_t *ir;
+  ir_block_t *succ;
+  ir_block_t *child;
+
+  for (ir = block->first; ir; ir = ir->next) {
+    if (ir->op != IR_PHI) {
+      n = ir_operand_count(ir);
+      for (j = 0; j < n; ++j) {
+        rename_use(ir_operand_slot(ir, j));
+      }
+    }
+    if (ir->dst && 0 <= tracked_bit[ir->dst - VREG_BASE]) {
+      reg = new_vreg();
+      ssa_origin[reg - VREG_BASE] = ir->dst;
+      set_ssa_version(ir->dst, reg);
+      ir->dst = reg;
+    }
+  }
+  for (i = 0; i < block_succ_count(block); ++i) {
+    succ = block_succ(block, i);
+    for (j = 0; j < succ->pred_count; ++j) {
+      if (succ->preds[j] != block) {
+        continue;
+      }
+      for (ir = succ->first; ir && ir->op == IR_PHI; ir = ir->next) {
+        ir->args[j] = ir->imm;
+        rename_use(ir->args + j);
+      }
+    }
+  }
+  for (child = block->dom_child; child; child = child->dom_sibling) {
+    rename_block(child);
+  }
+  while (mark < rename_log_count) {
+    rename_log_count = rename_log_count - 2;
+    ssa_current[rename_log[rename_log_count] - VREG_BASE] =
+        rename_log[rename_log_count + 1];
+  }
+}
+
+// a phi for reg at the start of block, its arguments filled by renaming.
+// imm keeps the vreg it merges
+void insert_phi(ir_block_t *block, int reg) {
+  ir_t *ir = arena_alloc(function_arena, sizeof(ir_t));
+  ir->op = IR_PHI;
+  ir->dst = reg;
+  ir->imm = reg;
+  ir->args = arena_alloc(function_arena, block->pred_count * sizeof(int));
+  ir->arg_count = block->pred_count;
+  ir->depth = block->first->depth;
+  ir->next = block->first;
+  block->first = ir;
+}
+
+// pruned SSA: a phi is placed in the iterated dominance frontier of the
+// definitions of a vreg, where the vreg is live
+void construct_ssa() {
+  dataflow_t *live = compute_liveness();
+  ir_block_t **work =
+      arena_alloc(function_arena, (block_count + 1) * sizeof(ir_block_t *));
+  int work_count;
+  int names = 0;
+  int site;
+  int i;
+  int v;
+  ir_t *ir;
+  ir_block_t *block;
+  ir_block_t *join;
+
+  number_definitions();
+  for (v = 0; v < vreg_count; ++v) {
+    if (tracked_bit[v] < 0) {
+      continue;
+    }
+    work_count = 0;
+    for (site = first_def_site[v]; 0 <= site; site = next_def_site[site]) {
+      block = blocks[def_site_block[site]];
+      if (block->def_mark != v + 1) {
+        block->def_mark = v + 1;
+        work[work_count] = block;
+        ++work_count;
+      }
+    }
+    while (work_count) {
+      --work_count;
+      block = work[work_count];
+      for (i = 0; i < block->frontier_count; ++i) {
+        join = block->frontier[i];
+        if (join->phi_mark == v + 1 ||
+            !bit_test(live->out[join->id], tracked_bit[v])) {
+          continue;
+        }
+        join->phi_mark = v + 1;
+        insert_phi(join, VREG_BASE + v);
+        if (join->def_mark != v + 1) {
+          join->def_mark = v + 1;
+          work[work_count] = join;
+          ++work_count;
+        }
+      }
+    }
+  }
+
+  // an undefined variable reads 0 from undef_reg
+  undef_reg = new_vreg();
+  tracked_bit[undef_reg - VREG_BASE] = -1;
+  ir = arena_alloc(function_arena, sizeof(ir_t));
+  ir->op = IR_CONST;
+  ir->dst = undef_reg;
+  ir->depth = blocks[0]->first->depth;
+  ir->next = blocks[0]->first;
+  blocks[0]->first = ir;
+
+  ssa_base = vreg_count;
+  for (i = 0; i < block_count; ++i) {
+    for (ir = blocks[i]->first; ir; ir = ir->next) {
+      if (ir->dst) {
+        ++names;
+      }
+    }
+  }
+  ssa_origin =
+      arena_alloc(function_arena, (vreg_count + names + 1) * sizeof(int));
+  ssa_current = arena_alloc(function_arena, (vreg_count + 1) * sizeof(int));
+  rename_log = arena_alloc(function_arena, (2 * names + 2) * sizeof(int));
+  rename_log_count = 0;
+  for (v = 0; v < vreg_count; ++v) {
+    ssa_origin[v] = VREG_BASE + v;
+  }
+  rename_block(blocks[0]);
+}
+
+bool ssa_use_dominated(ir_block_t *def, int def_pos, ir_block_t *use,
+                       int use_pos) {
+  if (!def) {
+    return 0;
+  } else if (def == use) {
+    return def_pos < use_pos;
+  }
+  return dominates(def, use);
+}
+
+// every vreg is written once, and before each read of it: earlier in the
+// same block or in a dominating block, or for a phi argument, by the end of
+// the predecessor it comes from
+void verify_ssa() {
+  ir_block_t **def_block =
+      arena_alloc(function_arena, (vreg_count + 1) * sizeof(ir_block_t *));
+  int *def_pos = arena_alloc(function_arena, (vreg_count + 1) * sizeof(int));
+  int i;
+  int j;
+  int n;
+  int v;
+  int pos;
+  ir_t *ir;
+  ir_block_t *block;
+
+  for (i = 0; i < block_count; ++i) {
+    pos = 0;
+    for (ir = blocks[i]->first; ir; ir = ir->next) {
+      ir->id = pos;
+      ++pos;
+      if (!ir->dst) {
+        continue;
+      }
+      v = ir->dst - VREG_BASE;
+      if (def_block[v]) {
+        error("ir: %%%d is written twice", v);
+      }
+      def_block[v] = blocks[i];
+      def_pos[v] = ir->id;
+    }
+  }
+  for (i = 0; i < block_count; ++i) {
+    block = blocks[i];
+    for (ir = block->first; ir; ir = ir->next) {
+      if (ir->op == IR_PHI && ir->arg_count != block->pred_count) {
+        error("ir: phi in block %d without an argument per predecessor", i);
+      }
+      n = ir_operand_count(ir);
+      for (j = 0; j < n; ++j) {
+        v = ir_operand(ir, j) - VREG_BASE;
+        if (ir->op == IR_PHI &&
+            ssa_use_dominated(def_block[v], def_pos[v], block->preds[j],
+                              block->preds[j]->last->id + 1)) {
+          continue;
+        } else if (ir->op != IR_PHI &&
+                   ssa_use_dominated(def_block[v], def_pos[v], block,
+                                     ir->id)) {
+          continue;
+        }
+        error("ir: %%%d is read where it is not defined", v);
+      }
+    }
+  }
+}
+
+// removes the instructions whose result is never read and that do nothing
+// else, until there are none. a call just loses its result
+void eliminate_dead_code() {
+  int *uses = arena_alloc(function_arena, (vreg_count + 1) * sizeof(int));
+  ir_t **def = arena_alloc(function_arena, (vreg_count + 1) * sizeof(ir_t *));
+  ir_t **work =
+      arena_alloc(function_arena, (vreg_count + 1) * sizeof(ir_t *));
+  int work_count = 0;
+  int i;
+  int j;
+  int n;
+  int v;
+  ir_t *ir;
+  ir_t *prev;
+
+  for (i = 0; i < block_count; ++i) {
+    for (ir = blocks[i]->first; ir; ir = ir->next) {
+      if (ir->dst) {
+        def[ir->dst - VREG_BASE] = ir;
+      }
+      n = ir_operand_count(ir);
+      for (j = 0; j < n; ++j) {
+        ++uses[ir_operand(ir, j) - VREG_BASE];
+      }
+    }
+  }
+  for (i = 0; i < block_count; ++i) {
+    for (ir = blocks[i]->first; ir; ir = ir->next) {
+      if (ir->dst && !uses[ir->dst - VREG_BASE]) {
+        work[work_count] = ir;
+        ++work_count;
+      }
+    }
+  }
+  while (work_count) {
+    --work_count;
+    ir = work[work_count];
+    if (ir->op == IR_CALL) {
+      ir->dst = 0;
+      continue;
+    }
+    n = ir_operand_count(ir);
+    for (j = 0; j < n; ++j) {
+      v = ir_operand(ir, j) - VREG_BASE;
+      --uses[v];
+      if (!uses[v] && def[v]) {
+        work[work_count] = def[v];
+        ++work_count;
+      }
+    }
+    ir->op = 0;  // unlinked below
+  }
+
+  for (i = 0; i < block_count; ++i) {
+    prev = NULL;
+    for (ir = blocks[i]->first; ir; ir = ir->next) {
+      if (ir->op) {
+        prev = ir;
+      } else if (prev) {
+        prev->next = ir->next;
+      } else {
+        blocks[i]->first = ir->next;
+      }
+    }
+  }
+}
+
+// dst = src before the terminator of block
+void insert_copy(ir_block_t *block, int dst, int src) {
+  ir_t *ir = arena_alloc(function_arena, sizeof(ir_t));
+  ir_t *prev;
+  ir->op = IR_MOV;
+  ir->dst = dst;
+  ir->a = src;
+  ir->depth = block->last->depth;
+  ir->next = block->last;
+  if (block->first == block->last) {
+    block->first = ir;
+    return;
+  }
+  for (prev = block->first; prev->next != block->last; prev = prev->next) {
+  }
+  prev->next = ir;
+}
+
+// a new block on the edge from pred to block, laid out last
+ir_block_t *split_edge(ir_block_t *pred, ir_block_t *block) {
+  ir_block_t *edge = new_block(".L.edge", gen_label_index(), NULL);
+  if (pred->last->target == block) {
+    pred->last->target = edge;
+  } else {
+    pred->last->target_else = edge;
+  }
+  start_block(edge);
+  ir_jump(block);
+  edge->last->depth = block->first->depth;
+  return edge;
+}
+
+// gives every version its vreg back. a phi argument of another vreg, like
+// undef_reg, is copied at the end of its predecessor, on an edge of its own
+// if the predecessor has another successor
+void destruct_ssa() {
+  int n = block_count;
+  ir_block_t **edges;  // where the copies for each predecessor go
+  int i;
+  int j;
+  int operands;
+  int src;
+  int *slot;
+  ir_t *ir;
+  ir_block_t *block;
+
+  for (i = 0; i < n; ++i) {
+    for (ir = blocks[i]->first; ir; ir = ir->next) {
+      if (ir->dst) {
+        ir->dst = ssa_origin[ir->dst - VREG_BASE];
+      }
+      if (ir->op != IR_PHI) {
+        operands = ir_operand_count(ir);
+        for (j = 0; j < operands; ++j) {
+          slot = ir_operand_slot(ir, j);
+          *slot = ssa_origin[*slot - VREG_BASE];
+        }
+      }
+    }
+  }
+  for (i = 0; i < n; ++i) {
+    block = blocks[i];
+    if (block->first->op != IR_PHI) {
+      continue;
+    }
+    edges =
+        arena_alloc(function_arena, block->pred_count * sizeof(ir_block_t *));
+    for (j = 0; j < block->pred_count; ++j) {
+      edges[j] = block->preds[j];
+    }
+    for (ir = block->first; ir && ir->op == IR_PHI; ir = ir->next) {
+      for (j = 0; j < ir->arg_count; ++j) {
+        src = ssa_origin[ir->args[j] - VREG_BASE];
+        if (src == ir->dst) {
+          continue;
+        }
+        if (edges[j] == block->preds[j] && 1 < block_succ_count(edges[j])) {
+          edges[j] = split_edge(edges[j], block);
+        }
+        insert_copy(edges[j], ir->dst, src);
+      }
+    }
+    block->first = ir;
+  }
+  vreg_count = ssa_base;
+}
+
+// base + offset of a struct member
+int gen_member_offset(int base, node_t *member) {
+  int reg = ir_binary_imm(IR_ADD, base, member->offset);
+  ir_comment("member: ", member->name);
+  return reg;
+}
+
+int gen(node_t *node);
+
+// returns the register holding the address of an lvalue
+int gen_lval(node_t *node) {
+  int reg;
+  global_variable_t *var;
+  if (node->kind == NODE_LOCAL_VARIABLE) {
+    reg = ir_address(IR_ADDR_LOCAL, node->local->offset, 0);
+    ir_comment("local variable: ", node->name);
+    return reg;
+  } else if (node->kind == NODE_GLOBAL_VARIABLE) {
+    var = find_global_variable(node->name);
+    var->referenced = 1;
+    return ir_address(IR_ADDR_GLOBAL, 0, node->name);
+  } else if (node->kind == NODE_DEREF) {
+    return gen(node->rhs);
+  } else if (node->kind == NODE_DOT) {
+    return gen_member_offset(gen_lval(node->lhs), node->rhs);
+  } else if (node->kind == NODE_ARROW) {
+    return gen_member_offset(gen(node->lhs), node->rhs);
+  }
+  error("左辺値が左辺値ではない！ kind=%d", node->kind);
+  return 0;
+}
+
+// *addr, sized by type
+int gen_load(type_t *type, int addr) {
+  if (type->size != 4 && type->size != 1) {
+    error("invalid size of type: %zd\n", type->size);
+  }
+  return ir_load(type->size, addr, 0);
+}
+
+// *addr = value, sized by type. returns the stored value
+int gen_store(type_t *type, int value, int addr) {
+  if (type->size == 1) {
+    value = ir_unary(IR_ZEXT8, value);
+  } else if (type->size != 4) {
+    error("invalid size of type: %zd\n", type->size);
+  }
+  ir_store(type->size, value, addr, 0);
+  return value;
+}
+
+// a variable kept in a register is written like memory of its type: a char
+// is truncated and sign extended as if stored with sb and loaded with lb
+int gen_assign_variable(local_variable_t *var, int value) {
+  if (var->type->size == 1) {
+    ir_unary_to(IR_SEXT8, var->reg, value);
+    return ir_unary(IR_ZEXT8, value);
+  }
+  ir_unary_to(IR_MOV, var->reg, value);
+  return value;
+}
+
+// without the M extension (--march=rv32i) there is no mul, div or rem. a
+// multiply by a constant still becomes shifts and adds in isel, and so does
+// a division by a constant unless the sequence costs more than the libgcc
+// routine. anything else calls the routine
+bool target_has_m = 1;
+
+// a call of __divsi3 or __modsi3 on rv32i, which divide bit by bit, in
+// instructions for typical operands
+const int LIBCALL_DIV_COST = 100;
+
+// k if n is 2^k, else -1
+int exact_log2(int n) {
+  int k = 0;
+  if (n <= 0) {
+    return -1;
+  }
+  while (n % 2 == 0) {
+    n = n / 2;
+    ++k;
+  }
+  if (n != 1) {
+    return -1;
+  }
+  return k;
+}
+
+int divisor_cost(int op, int d);
+
+// whether isel computes x op d, for op IR_DIV or IR_MOD, without div, rem
+// or a call
+bool is_const_divisor(int op, int d) {
+  if (d == 0 || d == -2147483647 - 1) {
+    return 0;
+  }
+  return target_has_m || divisor_cost(op, d) <= LIBCALL_DIV_COST;
+}
+
+// whether isel computes lhs op rhs without a call
+bool has_tile(int op, node_t *rhs) {
+  if (target_has_m || (op != IR_MUL && op != IR_DIV && op != IR_MOD)) {
+    return 1;
+  } else if (rhs->kind != NODE_NUM) {
+    return 0;
+  }
+  return op == IR_MUL || is_const_divisor(op, rhs->val);
+}
+
+int gen_libcall(char *name, int a, int b) {
+  ir_t *ir = new_ir(IR_CALL);
+  ir->dst = new_vreg();
+  ir->name = intern_name(name);
+  ir->args = arena_alloc(function_arena, 2 * sizeof(int));
+  ir->args[0] = a;
+  ir->args[1] = b;
+  ir->arg_count = 2;
+  return ir->dst;
+}
+
+// evaluates lhs, then rhs, and combines them with op. a constant factor
+// goes on the right, where isel looks for it
+int gen_operation(int op, node_t *node) {
+  node_t *lhs_node = node->lhs;
+  node_t *rhs_node = node->rhs;
+  int lhs;
+  int rhs;
+  if (op == IR_MUL && lhs_node->kind == NODE_NUM) {
+    lhs_node = node->rhs;
+    rhs_node = node->lhs;
+  }
+  lhs = gen(lhs_node);
+  if ((op == IR_EQ || op == IR_NE) && is_num(rhs_node, 0)) {
+    return ir_binary_imm(op, lhs, 0);
+  }
+  rhs = gen(rhs_node);
+  if (has_tile(op, rhs_node)) {
+    return ir_binary(op, lhs, rhs);
+  } else if (op == IR_MUL) {
+    return gen_libcall("__mulsi3", lhs, rhs);
+  } else if (op == IR_DIV) {
+    return gen_libcall("__divsi3", lhs, rhs);
+  }
+  return gen_libcall("__modsi3", lhs, rhs);
+}
+
+// the IR op of a comparison node, 0 for other nodes
+int compare_op(node_t *node) {
+  if (node->kind == NODE_LT) {
+    return IR_LT;
+  } else if (node->kind == NODE_LE) {
+    return IR_LE;
+  } else if (node->kind == NODE_GT) {
+    return IR_GT;
+  } else if (node->kind == NODE_GE) {
+    return IR_GE;
+  } else if (node->kind == NODE_EQ) {
+    return IR_EQ;
+  } else if (node->kind == NODE_NEQ) {
+    return IR_NE;
+  }
+  return 0;
+}
+
+// reg * size, for pointer arithmetic
+int gen_scale(int reg, int size) { return ir_binary_imm(IR_MUL, reg, size); }
+
+// inlining. after a function is compiled its body may be kept, copied out of
+// the function arena, and a later call to it expanded in place: the
+// arguments are moved to fresh registers standing for the parameters, and a
+// return becomes a jump to the end of the expansion. a call is expanded if
+// the body is small enough; the limit is raised for calls in loops, for
+// constant arguments, which the expansion turns into immediates, and for
+// functions declared inline.
+//
+// a body with a loop or with a local in memory is not kept. the locals of an
+// expansion are temporaries of the caller, whose live ranges the allocator
+// only extends over a loop they were live into, and the frame of the caller
+// has no room for them
+struct inline_body_t {
+  int name;
+  type_t *ret;
+  node_t **statements;
+  int statement_count;
+  local_variable_t **args;
+  int arg_count;
+  local_variable_t *locals;  // including the parameters
+  int size;                  // nodes in the body
+  bool hint;                 // declared inline
+  char *refusal;             // why it is not kept, NULL if it is
+
+  // while it is being expanded. a call to it from its own expansion is
+  // left a call, which keeps recursion finite
+  bool expanding;
+  ir_block_t *end_block;
+  int result;
+};
+typedef struct inline_body_t inline_body_t;
+
+const int INLINE_SIZE_LIMIT = 6;      // nodes of a body expanded at any call
+const int INLINE_HINT_LIMIT = 64;     // of a function declared inline
+const int INLINE_LOOP_BONUS = 6;      // for each loop around the call
+const int INLINE_CONST_BONUS = 4;     // for each constant argument
+const int INLINE_GROWTH_LIMIT = 200;  // nodes expanded into one function
+
+bool inline_remarks = 0;          // every decision on stderr (--inline-remarks)
+declaration_t *current_function;  // being compiled
+int inline_growth;                // nodes expanded into it so far
+int loop_depth;                   // loops around the node being compiled
+inline_body_t *current_inline;    // innermost expansion, NULL outside any
+
+char *scan_refusal;  // why the body scanned last cannot be kept
+
+// nodes of a body, noting in scan_refusal what keeps it from being kept
+int scan_inline_body(node_t *node, int name) {
+  int i;
+  int n;
+  if (!node) {
+    return 0;
+  }
+  if (node->kind == NODE_WHILE || node->kind == NODE_FOR) {
+    scan_refusal = "it has a loop";
+  } else if (node->kind == NODE_CALL && node->name == name) {
+    scan_refusal = "it is recursive";
+  }
+  n = 1 + scan_inline_body(node->lhs, name) +
+      scan_inline_body(node->rhs, name) + scan_inline_body(node->cond, name) +
+      scan_inline_body(node->clause_then, name) +
+      scan_inline_body(node->clause_else, name);
+  for (i = 0; i < node->child_count; ++i) {
+    n = n + scan_inline_body(node->children[i], name);
+  }
+  return n;
+}
+
+node_t *copy_node(node_t *node) {
+  node_t *copy;
+  int i;
+  if (!node) {
+    return NULL;
+  }
+  copy = arena_alloc(program_arena, sizeof(node_t));
+  memcpy(copy, node, sizeof(node_t));
+  copy->lhs = copy_node(node->lhs);
+  copy->rhs = copy_node(node->rhs);
+  copy->cond = copy_node(node->cond);
+  copy->clause_then = copy_node(node->clause_then);
+  copy->clause_else = copy_node(node->clause_else);
+  if (node->local) {
+    copy->local = node->local->copy;
+  }
+  if (node->const_str) {
+    copy->const_str = arena_alloc(program_arena, sizeof(constant_string_t));
+    memcpy(copy->const_str, node->const_str, sizeof(constant_string_t));
+    copy->const_str->next = NULL;
+  }
+  copy->children =
+      arena_alloc(program_arena, (node->child_count + 1) * sizeof(node_t *));
+  for (i = 0; i < node->child_count; ++i) {
+    copy->children[i] = copy_node(node->children[i]);
+  }
+  return copy;
+}
+
+// keeps the function just compiled for expanding later calls to it, or
+// notes why it is not kept
+void keep_inline_body(declaration_t *dec) {
+  inline_body_t *body = arena_alloc(program_arena, sizeof(inline_body_t));
+  local_variable_t *var;
+  local_variable_t *copy;
+  size_t i;
+  body->name = dec->name;
+  body->ret = dec->type->ret;
+  body->hint = dec->is_inline;
+  idents[dec->name].inline_body = body;
+
+  scan_refusal = NULL;
+  for (i = 0; i < dec->func_statement_count; ++i) {
+    body->size =
+        body->size + scan_inline_body(dec->func_statements[i], dec->name);
+  }
+  for (var = local_variables; var; var = var->next) {
+    if (!var->reg) {
+      scan_refusal = "a local lives in memory";
+    }
+  }
+  if (INLINE_HINT_LIMIT < body->size) {
+    scan_refusal = "it is too large";
+  }
+  body->refusal = scan_refusal;
+  if (body->refusal) {
+    return;
+  }
+
+  for (var = local_variables; var; var = var->next) {
+    copy = arena_alloc(program_arena, sizeof(local_variable_t));
+    memcpy(copy, var, sizeof(local_variable_t));
+    copy->shadowed = NULL;
+    copy->next = body->locals;
+    body->locals = copy;
+    var->copy = copy;
+  }
+  body->arg_count = dec->func_arg_count;
+  body->args = arena_alloc(
+      program_arena, (dec->func_arg_count + 1) * sizeof(local_variable_t *));
+  for (i = 0; i < dec->func_arg_count; ++i) {
+    body->args[i] = dec->func_args[i]->copy;
+  }
+  body->statement_count = dec->func_statement_count;
+  body->statements = arena_alloc(
+      program_arena, (dec->func_statement_count + 1) * sizeof(node_t *));
+  for (i = 0; i < dec->func_statement_count; ++i) {
+    body->statements[i] = copy_node(dec->func_statements[i]);
+  }
+}
+
+// the size of body up to which a call is expanded
+int inline_limit(inline_body_t *body, node_t *call) {
+  int limit = INLINE_SIZE_LIMIT;
+  int i;
+  if (body->hint) {
+    limit = INLINE_HINT_LIMIT;
+  }
+  for (i = 0; i < call->child_count; ++i) {
+    if (call->children[i]->kind == NODE_NUM) {
+      limit = limit + INLINE_CONST_BONUS;
+    }
+  }
+  return limit + loop_depth * INLINE_LOOP_BONUS;
+}
+
+// whether to expand call to body, remarked on with --inline-remarks
+bool should_inline(inline_body_t *body, node_t *call) {
+  char *refusal = body->refusal;
+  int limit = inline_limit(body, call);
+  if (refusal) {
+    // noted when the body was compiled
+  } else if (body->expanding) {
+    refusal = "it calls itself through another function";
+  } else if (body->arg_count != call->child_count) {
+    refusal = "the argument count differs";
+  } else if (limit < body->size) {
+    refusal = "it is too large";
+  } else if (INLINE_GROWTH_LIMIT < inline_growth + body->size) {
+    refusal = "the caller has grown too much";
+  }
+  if (inline_remarks) {
+    eprintf("inline %.*s into %.*s: ", ident_len(body->name),
+            ident_str(body->name), ident_len(current_function->name),
+            ident_str(current_function->name));
+    if (refusal) {
+      eprintf("not inlined, %s", refusal);
+    } else {
+      eprintf("inlined");
+    }
+    eprintf(" (size %d, limit %d)\n", body->size, limit);
+  }
+  return refusal == NULL;
+}
+
+// the expansion of a call to body, args holding the evaluated arguments
+int gen_inline(inline_body_t *body, int *args) {
+  inline_body_t *outer = current_inline;
+  local_variable_t *var;
+  int i;
+  for (var = body->locals; var; var = var->next) {
+    var->reg = new_vreg();
+  }
+  for (i = 0; i < body->arg_count; ++i) {
+    gen_assign_variable(body->args[i], args[i]);
+  }
+  body->end_block = new_block(".L.inline.end", gen_label_index(), NULL);
+  body->result = new_vreg();
+  body->expanding = 1;
+  current_inline = body;
+  inline_growth = inline_growth + body->size;
+  for (i = 0; i < body->statement_count; ++i) {
+    gen(body->statements[i]);
+  }
+  start_block(body->end_block);
+  current_inline = outer;
+  body->expanding = 0;
+  return body->result;
+}
+
+// a return from the expansion being compiled
+void gen_inline_return(node_t *node) {
+  if (node->rhs) {
+    ir_unary_to(IR_MOV, current_inline->result, gen(node->rhs));
+  } else if (current_inline->ret->ty != TYPE_VOID) {
+    // falling off the end of a function returning a value
+    ir_unary_to(IR_MOV, current_inline->result, ir_const(0));
+  }
+  ir_jump(current_inline->end_block);
+}
+
+// tail recursion: `return f(...)` in f itself moves the arguments to the
+// parameters and jumps back to the start of the body, so that the
+// recursion runs as a loop in one frame. not in a function with locals in
+// memory, whose addresses an argument could hold
+ir_block_t *tail_block;  // the start of the body, NULL without such returns
+
+bool is_tail_recursion(node_t *node) {
+  return node->kind == NODE_RETURN && node->rhs &&
+         node->rhs->kind == NODE_CALL &&
+         node->rhs->name == current_function->name &&
+         node->rhs->child_count == current_function->func_arg_count &&
+         !current_inline;
+}
+
+bool has_tail_recursion(node_t *node) {
+  int i;
+  if (!node) {
+    return 0;
+  }
+  if (is_tail_recursion(node)) {
+    return 1;
+  }
+  if (has_tail_recursion(node->clause_then) ||
+      has_tail_recursion(node->clause_else)) {
+    return 1;
+  }
+  for (i = 0; i < node->child_count; ++i) {
+    if (node->kind == NODE_BLOCK && has_tail_recursion(node->children[i])) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+void gen_tail_recursion(node_t *call) {
+  int i;
+  int *args =
+      arena_alloc(function_arena, (call->child_count + 1) * sizeof(int));
+  for (i = call->child_count - 1; 0 <= i; --i) {
+    args[i] = gen(call->children[i]);
+    // a parameter passed on as it is must keep its value until all of
+    // them are assigned
+    if (args[i] - VREG_BASE < variable_vreg_count) {
+      args[i] = ir_unary(IR_MOV, args[i]);
+    }
+  }
+  for (i = 0; i < call->child_count; ++i) {
+    gen_assign_variable(current_function->func_args[i], args[i]);
+  }
+  ir_jump(tail_block);
+}
+
+int gen_call(node_t *node) {
+  int i;
+  int *args =
+      arena_alloc(function_arena, (node->child_count + 1) * sizeof(int));
+  ir_t *ir;
+  inline_body_t *body = idents[node->name].inline_body;
+  bool expand = body && should_inline(body, node);
+  for (i = node->child_count - 1; 0 <= i; --i) {
+    args[i] = gen(node->children[i]);
+  }
+  if (expand) {
+    return gen_inline(body, args);
+  }
+  ir = new_ir(IR_CALL);
+  ir->dst = new_vreg();
+  ir->name = node->name;
+  ir->args = args;
+  ir->arg_count = node->child_count;
+  return ir->dst;
+}
+
+// a condition in branch context: jumps to then_block if it holds, else to
+// else_block. comparisons become compare-and-branch, and && || ! pick the
+// targets of their operands instead of computing a value
+void gen_cond(node_t *node, ir_block_t *then_block, ir_block_t *else_block) {
+  int op = compare_op(node);
+  int lhs;
+  int rhs = 0;
+  ir_block_t *rhs_block;
+  if (node->kind == NODE_LOGICAL_AND) {
+    rhs_block = new_block(".L.and.rhs", gen_label_index(), NULL);
+    gen_cond(node->lhs, rhs_block, else_block);
+    start_block(rhs_block);
+    gen_cond(node->rhs, then_block, else_block);
+  } else if (node->kind == NODE_LOGICAL_OR) {
+    rhs_block = new_block(".L.or.rhs", gen_label_index(), NULL);
+    gen_cond(node->lhs, then_block, rhs_block);
+    start_block(rhs_block);
+    gen_cond(node->rhs, then_block, else_block);
+  } else if (node->kind == NODE_LOGICAL_NOT) {
+    gen_cond(node->rhs, else_block, then_block);
+  } else if (node->kind == NODE_NUM && node->val) {
+    ir_jump(then_block);
+  } else if (node->kind == NODE_NUM) {
+    ir_jump(else_block);
+  } else if (op) {
+    lhs = gen(node->lhs);
+    if (!is_num(node->rhs, 0)) {
+      rhs = gen(node->rhs);
+    }
+    ir_compare_branch(op, lhs, rhs, then_block, else_block);
+  } else {
+    ir_branch(gen(node), then_block, else_block);
+  }
+}
+
+// the value of a node as a condition, 0 or 1
+int gen_truth(node_t *node) {
+  int reg = gen(node);
+  if (is_boolean(node)) {
+    return reg;
+  }
+  return ir_binary_imm(IR_NE, reg, 0);
+}
+
+// lhs && rhs or lhs || rhs: the value of lhs if it decides the result,
+// else the value of rhs
+int gen_logical(node_t *node, char *rhs_prefix, char *end_prefix) {
+  int index = gen_label_index();
+  ir_block_t *rhs_block = new_block(rhs_prefix, index, NULL);
+  ir_block_t *end_block = new_block(end_prefix, index, NULL);
+  int reg = new_vreg();
+  ir_unary_to(IR_MOV, reg, gen_truth(node->lhs));
+  if (node->kind == NODE_LOGICAL_AND) {
+    ir_branch(reg, rhs_block, end_block);
+  } else {
+    ir_branch(reg, end_block, rhs_block);
+  }
+  start_block(rhs_block);
+  ir_unary_to(IR_MOV, reg, gen_truth(node->rhs));
+  start_block(end_block);
+  return reg;
+}
+
+void gen_if(node_t *node) {
+  int index = gen_label_index();
+  ir_block_t *then_block = new_block(".L.then", index, NULL);
+  ir_block_t *else_block = NULL;
+  ir_block_t *end_block = new_block(".L.if.end", index, NULL);
+  if (node->clause_else) {
+    else_block = new_block(".L.else", index, NULL);
+    gen_cond(node->cond, then_block, else_block);
+  } else {
+    gen_cond(node->cond, then_block, end_block);
+  }
+  start_block(then_block);
+  gen(node->clause_then);
+  if (else_block) {
+    if (cur_block) {
+      ir_jump(end_block);
+    }
+    start_block(else_block);
+    gen(node->clause_else);
+  }
+  start_block(end_block);
+}
+
+// while (cond) body and for (init; cond; next) body
+void gen_loop(node_t *node) {
+  ir_block_t *old_break_block = break_block;
+  ir_block_t *old_continue_block = continue_block;
+  int index = gen_label_index();
+  ir_block_t *cond_block = new_block(".L.loop.cond", index, "loop cond");
+  ir_block_t *body_block = new_block(".L.loop.body", index, NULL);
+  ir_block_t *next_block = NULL;
+  break_block = new_block(".L.loop.end", index, "loop end");
+  continue_block = cond_block;
+  ++loop_depth;
+  if (node->kind == NODE_FOR) {
+    next_block = new_block(".L.loop.next", index, "loop next");
+    continue_block = next_block;
+    if (node->init) {
+      gen(node->init);
+    }
+  }
+  start_block(cond_block);
+  if (node->cond) {
+    gen_cond(node->cond, body_block, break_block);
+  }
+  start_block(body_block);
+  gen(node->clause_then);
+  if (next_block) {
+    start_block(next_block);
+    if (node->next) {
+      gen(node->next);
+    }
+  }
+  ir_jump(cond_block);
+  start_block(break_block);
+  --loop_depth;
+  break_block = old_break_block;
+  continue_block = old_continue_block;
+}
+
+// returns the register holding the value of the node, 0 for statements
+int gen(node_t *node) {
+  int i;
+  int reg = 0;
+  int lhs;
+  int rhs;
+
+  inc_depth();
+  if (trace_gen) {
+    print_node(node);
+    eprintf("\n");
+  }
+
+  if (node->kind == NODE_NUM) {
+    reg = ir_const(node->val);
+  } else if (node->kind == NODE_CONST_STRING) {
+    reg = ir_address(IR_ADDR_STRING, node->const_str->id, 0);
+  } else if (node->kind == NODE_MINUS) {
+    reg = ir_unary(IR_NEG, gen(node->rhs));
+  } else if (node->kind == NODE_ADD) {
+    lhs = gen(node->lhs);
+    rhs = gen(node->rhs);
+    if (node->lhs->type->ty == TYPE_POINTER ||
+        node->lhs->type->ty == TYPE_ARRAY) {
+      rhs = gen_scale(rhs, node->lhs->type->ptr_to->size);
+    } else if (node->rhs->type->ty == TYPE_POINTER ||
+               node->rhs->type->ty == TYPE_ARRAY) {
+      lhs = gen_scale(lhs, node->rhs->type->ptr_to->size);
+    }
+    reg = ir_binary(IR_ADD, lhs, rhs);
+  } else if (node->kind == NODE_SUB) {
+    lhs = gen(node->lhs);
+    rhs = gen(node->rhs);
+    if (node->lhs->type->ty == TYPE_POINTER ||
+        node->lhs->type->ty == TYPE_ARRAY) {
+      rhs = gen_scale(rhs, 4);
+    } else if (node->rhs->type->ty == TYPE_POINTER ||
+               node->rhs->type->ty == TYPE_ARRAY) {
+      lhs = gen_scale(lhs, 4);
+    }
+    reg = ir_binary(IR_SUB, lhs, rhs);
+  } else if (node->kind == NODE_MUL) {
+    reg = gen_operation(IR_MUL, node);
+  } else if (node->kind == NODE_DIV) {
+    reg = gen_operation(IR_DIV, node);
+  } else if (node->kind == NODE_MOD) {
+    reg = gen_operation(IR_MOD, node);
+  } else if (node->kind == NODE_LT) {
+    reg = gen_operation(IR_LT, node);
+  } else if (node->kind == NODE_LE) {
+    reg = gen_operation(IR_LE, node);
+  } else if (node->kind == NODE_GT) {
+    reg = gen_operation(IR_GT, node);
+  } else if (node->kind == NODE_GE) {
+    reg = gen_operation(IR_GE, node);
+  } else if (node->kind == NODE_LOGICAL_AND) {
+    reg = gen_logical(node, ".L.and.rhs", ".L.and.end");
+  } else if (node->kind == NODE_LOGICAL_OR) {
+    reg = gen_logical(node, ".L.or.rhs", ".L.or.end");
+  } else if (node->kind == NODE_LOGICAL_NOT) {
+    reg = ir_unary(IR_NOT, gen(node->rhs));
+  } else if (node->kind == NODE_EQ) {
+    reg = gen_operation(IR_EQ, node);
+  } else if (node->kind == NODE_NEQ) {
+    reg = gen_operation(IR_NE, node);
+  } else if (node->kind == NODE_BITWISE_AND) {
+    reg = gen_operation(IR_AND, node);
+  } else if (node->kind == NODE_BITWISE_XOR) {
+    reg = gen_operation(IR_XOR, node);
+  } else if (node->kind == NODE_BITWISE_OR) {
+    reg = gen_operation(IR_OR, node);
+  } else if (node->kind == NODE_LOCAL_VARIABLE && node->local->reg) {
+    reg = node->local->reg;
+  } else if (node->kind == NODE_LOCAL_VARIABLE ||
+             node->kind == NODE_GLOBAL_VARIABLE || node->kind == NODE_DOT ||
+             node->kind == NODE_ARROW) {
+    reg = gen_lval(node);
+    if (node->type->ty != TYPE_ARRAY) {
+      reg = gen_load(node->type, reg);
+    }
+  } else if (node->kind == NODE_ASSIGN ||
+             (node->kind == NODE_VAR_DEC && node->rhs)) {
+    rhs = gen(node->rhs);
+    if (node->lhs->kind == NODE_LOCAL_VARIABLE && node->lhs->local->reg) {
+      reg = gen_assign_variable(node->lhs->local, rhs);
+    } else {
+      lhs = gen_lval(node->lhs);
+      reg = gen_store(node->type, rhs, lhs);
+    }
+  } else if (node->kind == NODE_VAR_DEC) {
+    // no initializer
+  } else if (node->kind == NODE_RETURN && current_inline) {
+    gen_inline_return(node);
+  } else if (tail_block && is_tail_recursion(node)) {
+    gen_tail_recursion(node->rhs);
+  } else if (node->kind == NODE_RETURN) {
+    if (node->rhs) {
+      ir_return(gen(node->rhs));
+    } else {
+      ir_return(0);
+    }
+  } else if (node->kind == NODE_BREAK) {
+    ir_jump(break_block);
+  } else if (node->kind == NODE_CONTINUE) {
+    ir_jump(continue_block);
+  } else if (node->kind == NODE_IF) {
+    gen_if(node);
+  } else if (node->kind == NODE_WHILE || node->kind == NODE_FOR) {
+    gen_loop(node);
+  } else if (node->kind == NODE_BLOCK) {
+    for (i = 0; i < node->child_count; ++i) {
+      gen(node->children[i]);
+    }
+  } else if (node->kind == NODE_CALL) {
+    reg = gen_call(node);
+  } else if (node->kind == NODE_ADDR) {
+    reg = gen_lval(node->rhs);
+  } else if (node->kind == NODE_DEREF) {
+    reg = gen_load(node->type, gen(node->rhs));
+  } else {
+    error("gen invalid node, kind=%d", node->kind);
+  }
+  dec_depth();
+  return reg;
+}
+
+// instruction selection tiles expression trees with the rules of a tree
+// grammar, choosing the cheapest cover bottom-up as a BURS matcher does.
+// a value defined once and used once, later in its block, is computed at
+// its use, so the add of a member offset and the load of the member become
+// a single lw with a displacement
+
+bool is_imm12(int n) { return -2048 <= n && n < 2048; }
+
+// nonterminals: what a tile leaves for the tile above it
+const int NT_NONE = 0;
+const int NT_REG = 1;    // a register
+const int NT_IMM = 2;    // a constant that fits a 12-bit immediate
+const int NT_CONST = 3;  // any constant
+const int NT_ADDR = 4;   // a base register and a 12-bit displacement
+const int NT_MEM8 = 5;   // the byte at an NT_ADDR, not loaded yet
+const int NT_BYTE = 6;   // a register of which only the low byte matters
+const int NT_STMT = 7;   // a store, which leaves nothing
+#define NT_COUNT 8
+
+const int TILE_INFINITY = 1000000;
+const int MUL_COST = 3;   // of mul and mulh, in instructions
+const int DIV_COST = 20;  // of div and rem
+
+// conditions on a node beyond its shape
+const int COND_ZERO = 1;      // the constant is 0
+const int COND_IMM12 = 2;     // the constant or frame offset fits 12 bits
+const int COND_B_ZERO = 3;    // operand b is the constant 0
+const int COND_B_NEG12 = 4;   // -b fits 12 bits
+const int COND_B_PLUS1 = 5;   // b + 1 fits 12 bits
+const int COND_LOCAL_B = 6;   // a is a local whose offset + b fits 12 bits
+const int COND_SIZE1 = 7;     // a byte load or store
+const int COND_SIZE4 = 8;     // a word load or store
+const int COND_B_CONST = 9;   // operand b is a constant
+const int COND_DIVISOR = 10;  // b is a constant is_const_divisor() takes
+
+// how a rule is emitted into rd, its operands being a and b
+const int EMIT_PASS = 1;         // nothing, a is the result
+const int EMIT_ZERO = 2;         // nothing, the zero register
+const int EMIT_IMM = 3;          // nothing, the constant itself
+const int EMIT_LI = 4;           // li rd, a or the constant itself
+const int EMIT_RR = 5;           // op rd, a
+const int EMIT_RRR = 6;          // op rd, a, b
+const int EMIT_RRI = 7;          // op rd, a, sign * b + bias
+const int EMIT_SEXT8 = 8;        // slli t, a, 24; srai rd, t, 24
+const int EMIT_LOCAL = 9;        // addi rd, sp, frame offset
+const int EMIT_LA = 10;          // la rd, name
+const int EMIT_ADDR_LOCAL = 11;  // sp + frame offset
+const int EMIT_ADDR_ADD = 12;    // a + b
+const int EMIT_LOCAL_ADD = 13;   // sp + frame offset of a + b
+const int EMIT_LOAD = 14;        // op rd, a with a an address
+const int EMIT_STORE = 15;       // op b, a with a an address
+const int EMIT_MOVE = 16;        // a computed right into rd
+const int EMIT_MUL_CONST = 17;   // a * b by shifts and adds
+const int EMIT_DIV_CONST = 18;   // a / b by shifts or a multiply-high
+const int EMIT_MOD_CONST = 19;   // a % b likewise
+
+// a second instruction on the result, which goes to a temporary first
+const int THEN_INVERT = 1;  // xori rd, t, 1
+const int THEN_SEQZ = 2;    // seqz rd, t
+const int THEN_SNEZ = 3;    // snez rd, t
+
+struct rule_t {
+  int op;    // IR op of the node, 0 for a chain rule from nt a to nt
+  int cond;  // COND_*, 0 for none
+  int nt;    // what the rule derives
+  int a;     // what operand a has to derive, NT_NONE if it is not used
+  int b;
+  int cost;  // in instructions
+  int emit;  // EMIT_*
+  char *insn;
+  bool swap;  // a and b are exchanged in the instruction
+  int sign;   // of the immediate, see EMIT_RRI
+  int bias;
+  int then;   // THEN_*, 0 for none
+  struct rule_t *next;
+};
+typedef struct rule_t rule_t;
+
+rule_t *op_rules[IR_OP_COUNT];  // the rules for each op, in order
+rule_t *chain_rules;
+
+// appends a rule; ties in cost go to the rule added first
+rule_t *add_rule(int op, int cond, int nt, int a, int b, int cost, int emit,
+                 char *insn) {
+  rule_t *rule = calloc(1, sizeof(rule_t));
+  rule_t *last;
+  rule->op = op;
+  rule->cond = cond;
+  rule->nt = nt;
+  rule->a = a;
+  rule->b = b;
+  rule->cost = cost;
+  rule->emit = emit;
+  rule->insn = insn;
+  rule->sign = 1;
+  last = chain_rules;
+  if (op) {
+    last = op_rules[op];
+  }
+  if (!last) {
+    if (op) {
+      op_rules[op] = rule;
+    } else {
+      chain_rules = rule;
+    }
+    return rule;
+  }
+  while (last->next) {
+    last = last->next;
+  }
+  last->next = rule;
+  return rule;
+}
+
+// reg op reg and reg op imm12, as binary ops with an immediate form do
+void add_binary_rules(int op, char *imm_insn) {
+  add_rule(op, 0, NT_REG, NT_REG, NT_REG, 1, EMIT_RRR, ir_insn_ops[op]);
+  if (imm_insn) {
+    add_rule(op, 0, NT_REG, NT_REG, NT_IMM, 1, EMIT_RRI, imm_insn);
+  }
+}
+
+// a == b as (a ^ b) == 0, and a == 0 as is
+void add_equality_rules(int op, int then) {
+  rule_t *rule;
+  add_rule(op, COND_B_ZERO, NT_REG, NT_REG, NT_IMM, 1, EMIT_RR,
+           ir_zero_test_ops[op]);
+  rule = add_rule(op, 0, NT_REG, NT_REG, NT_IMM, 2, EMIT_RRI, "xori");
+  rule->then = then;
+  rule = add_rule(op, 0, NT_REG, NT_REG, NT_REG, 2, EMIT_RRR, "xor");
+  rule->then = then;
+}
+
+void init_tiles() {
+  rule_t *rule;
+  add_rule(IR_CONST, COND_ZERO, NT_REG, NT_NONE, NT_NONE, 0, EMIT_ZERO,
+           NULL);
+  add_rule(IR_CONST, COND_IMM12, NT_IMM, NT_NONE, NT_NONE, 0, EMIT_IMM,
+           NULL);
+  add_rule(IR_CONST, 0, NT_CONST, NT_NONE, NT_NONE, 0, EMIT_IMM, NULL);
+  add_rule(IR_CONST, 0, NT_REG, NT_NONE, NT_NONE, 1, EMIT_LI, "li");
+  add_rule(IR_ADDR_LOCAL, COND_IMM12, NT_ADDR, NT_NONE, NT_NONE, 0,
+           EMIT_ADDR_LOCAL, NULL);
+  add_rule(IR_ADDR_LOCAL, 0, NT_REG, NT_NONE, NT_NONE, 1, EMIT_LOCAL,
+           "addi");
+  add_rule(IR_ADDR_GLOBAL, 0, NT_REG, NT_NONE, NT_NONE, 2, EMIT_LA, NULL);
+  add_rule(IR_ADDR_STRING, 0, NT_REG, NT_NONE, NT_NONE, 2, EMIT_LA, NULL);
+  add_rule(IR_MOV, 0, NT_REG, NT_CONST, NT_NONE, 1, EMIT_LI, "li");
+  add_rule(IR_MOV, 0, NT_REG, NT_REG, NT_NONE, 1, EMIT_MOVE, "mv");
+  add_rule(IR_NEG, 0, NT_REG, NT_REG, NT_NONE, 1, EMIT_RR, "neg");
+  add_rule(IR_NOT, 0, NT_REG, NT_REG, NT_NONE, 1, EMIT_RR, "seqz");
+  add_rule(IR_SEXT8, 0, NT_REG, NT_MEM8, NT_NONE, 1, EMIT_LOAD, "lb");
+  add_rule(IR_SEXT8, 0, NT_REG, NT_REG, NT_NONE, 2, EMIT_SEXT8, NULL);
+  add_rule(IR_SEXT8, 0, NT_BYTE, NT_REG, NT_NONE, 0, EMIT_PASS, NULL);
+  add_rule(IR_ZEXT8, 0, NT_REG, NT_MEM8, NT_NONE, 1, EMIT_LOAD, "lbu");
+  rule = add_rule(IR_ZEXT8, 0, NT_REG, NT_REG, NT_NONE, 1, EMIT_RRI, "andi");
+  rule->sign = 0;
+  rule->bias = 255;
+  add_rule(IR_ZEXT8, 0, NT_BYTE, NT_REG, NT_NONE, 0, EMIT_PASS, NULL);
+
+  add_binary_rules(IR_ADD, "addi");
+  add_rule(IR_ADD, 0, NT_ADDR, NT_REG, NT_IMM, 0, EMIT_ADDR_ADD, NULL);
+  add_rule(IR_ADD, COND_LOCAL_B, NT_ADDR, NT_NONE, NT_CONST, 0,
+           EMIT_LOCAL_ADD, NULL);
+  add_binary_rules(IR_SUB, NULL);
+  rule = add_rule(IR_SUB, COND_B_NEG12, NT_REG, NT_REG, NT_CONST, 1,
+                  EMIT_RRI, "addi");
+  rule->sign = -1;
+  if (target_has_m) {
+    add_rule(IR_MUL, 0, NT_REG, NT_REG, NT_REG, MUL_COST, EMIT_RRR, "mul");
+    add_rule(IR_DIV, 0, NT_REG, NT_REG, NT_REG, DIV_COST, EMIT_RRR, "div");
+    add_rule(IR_MOD, 0, NT_REG, NT_REG, NT_REG, DIV_COST, EMIT_RRR, "rem");
+  }
+  add_rule(IR_MUL, COND_B_CONST, NT_REG, NT_REG, NT_CONST, 0, EMIT_MUL_CONST,
+           NULL);
+  add_rule(IR_DIV, COND_DIVISOR, NT_REG, NT_REG, NT_CONST, 0, EMIT_DIV_CONST,
+           NULL);
+  add_rule(IR_MOD, COND_DIVISOR, NT_REG, NT_REG, NT_CONST, 0, EMIT_MOD_CONST,
+           NULL);
+  add_binary_rules(IR_AND, "andi");
+  add_binary_rules(IR_OR, "ori");
+  add_binary_rules(IR_XOR, "xori");
+  add_binary_rules(IR_LT, "slti");
+  add_binary_rules(IR_GT, NULL);
+
+  // a > c is !(a < c + 1), a <= b is !(b < a) and a >= b is !(a < b)
+  rule = add_rule(IR_GT, COND_B_PLUS1, NT_REG, NT_REG, NT_CONST, 2, EMIT_RRI,
+                  "slti");
+  rule->bias = 1;
+  rule->then = THEN_INVERT;
+  rule = add_rule(IR_LE, COND_B_PLUS1, NT_REG, NT_REG, NT_CONST, 1, EMIT_RRI,
+                  "slti");
+  rule->bias = 1;
+  rule = add_rule(IR_LE, 0, NT_REG, NT_REG, NT_REG, 2, EMIT_RRR, "slt");
+  rule->swap = 1;
+  rule->then = THEN_INVERT;
+  rule = add_rule(IR_GE, 0, NT_REG, NT_REG, NT_IMM, 2, EMIT_RRI, "slti");
+  rule->then = THEN_INVERT;
+  rule = add_rule(IR_GE, 0, NT_REG, NT_REG, NT_REG, 2, EMIT_RRR, "slt");
+  rule->then = THEN_INVERT;
+  add_equality_rules(IR_EQ, THEN_SEQZ);
+  add_equality_rules(IR_NE, THEN_SNEZ);
+
+  add_rule(IR_LOAD, COND_SIZE4, NT_REG, NT_ADDR, NT_NONE, 1, EMIT_LOAD,
+           "lw");
+  add_rule(IR_LOAD, COND_SIZE1, NT_MEM8, NT_ADDR, NT_NONE, 0, EMIT_PASS,
+           NULL);
+  add_rule(IR_STORE, COND_SIZE4, NT_STMT, NT_ADDR, NT_REG, 1, EMIT_STORE,
+           "sw");
+  add_rule(IR_STORE, COND_SIZE1, NT_STMT, NT_ADDR, NT_BYTE, 1, EMIT_STORE,
+           "sb");
+
+  // applied in this order once the rules above are matched
+  add_rule(0, 0, NT_REG, NT_MEM8, NT_NONE, 1, EMIT_LOAD, "lb");
+  add_rule(0, 0, NT_ADDR, NT_REG, NT_NONE, 0, EMIT_PASS, NULL);
+  add_rule(0, 0, NT_BYTE, NT_REG, NT_NONE, 0, EMIT_PASS, NULL);
+}
+
+ir_t **tile_defs;  // by vreg, its only definition, NULL if there are more
+int tile_def_count;
+int *tile_written;      // by vreg, the position of its last write so far
+int tile_memory;        // the position of the last store or call so far
+int *tile_costs;        // by ir id and nonterminal, of the cheapest cover
+rule_t **tile_rules;    // the rule of that cover
+int tile_imm;           // the constant or displacement a reduction leaves
+int tile_value;         // the constant found by operand_is_const()
+ir_t *tile_comment_ir;  // a commented node that emitted nothing
+
+// the definition of reg if it is computed in the tree of its user
+ir_t *tree_def(int reg) {
+  ir_t *def;
+  if (reg < VREG_BASE || tile_def_count <= reg - VREG_BASE) {
+    return NULL;
+  }
+  def = tile_defs[reg - VREG_BASE];
+  if (def && def->in_tree) {
+    return def;
+  }
+  return NULL;
+}
+
+bool is_tree_op(int op) {
+  return op == IR_CONST || (IR_ADDR_LOCAL <= op && op <= IR_ADDR_STRING) ||
+         (IR_NEG <= op && op <= IR_NE) || op == IR_LOAD;
+}
+
+// whether def, and the tree under it, computes the same value when moved
+// down to the current position
+bool is_movable(ir_t *def) {
+  int i;
+  int reg;
+  ir_t *child;
+  int n = ir_operand_count(def);
+  for (i = 0; i < n; ++i) {
+    reg = ir_operand(def, i);
+    child = tree_def(reg);
+    if (child) {
+      if (!is_movable(child)) {
+        return 0;
+      }
+    } else if (def->id < tile_written[reg - VREG_BASE]) {
+      return 0;
+    }
+  }
+  return def->op != IR_LOAD || tile_memory < def->id;
+}
+
+// decides which values are computed in the tree of their user
+void mark_trees() {
+  int i;
+  int j;
+  int n;
+  int reg;
+  int pos = 0;
+  int start;
+  int *uses = arena_alloc(function_arena, vreg_count * sizeof(int));
+  int *defs = arena_alloc(function_arena, vreg_count * sizeof(int));
+  ir_t *ir;
+  ir_t *def;
+
+  tile_def_count = vreg_count;
+  tile_defs = arena_alloc(function_arena, vreg_count * sizeof(ir_t *));
+  tile_written = arena_alloc(function_arena, vreg_count * sizeof(int));
+  for (i = 0; i < block_count; ++i) {
+    for (ir = blocks[i]->first; ir; ir = ir->next) {
+      ir->id = pos;
+      ++pos;
+      if (ir->dst) {
+        ++defs[ir->dst - VREG_BASE];
+        tile_defs[ir->dst - VREG_BASE] = ir;
+      }
+      n = ir_operand_count(ir);
+      for (j = 0; j < n; ++j) {
+        ++uses[ir_operand(ir, j) - VREG_BASE];
+      }
+    }
+  }
+  for (i = 0; i < vreg_count; ++i) {
+    tile_written[i] = -1;
+    if (defs[i] != 1) {
+      tile_defs[i] = NULL;
+    }
+  }
+  tile_memory = -1;
+  for (i = 0; i < block_count; ++i) {
+    start = blocks[i]->first->id;
+    for (ir = blocks[i]->first; ir; ir = ir->next) {
+      n = ir_operand_count(ir);
+      for (j = 0; j < n; ++j) {
+        reg = ir_operand(ir, j);
+        def = tile_defs[reg - VREG_BASE];
+        if (def && uses[reg - VREG_BASE] == 1 && start <= def->id &&
+            def->id < ir->id && is_tree_op(def->op) && is_movable(def)) {
+          def->in_tree = 1;
+        }
+      }
+      if (ir->dst) {
+        tile_written[ir->dst - VREG_BASE] = ir->id;
+      }
+      if (ir->op == IR_STORE || ir->op == IR_CALL) {
+        tile_memory = ir->id;
+      }
+    }
+  }
+  tile_costs = arena_alloc(function_arena, pos * NT_COUNT * sizeof(int));
+  tile_rules = arena_alloc(function_arena, pos * NT_COUNT * sizeof(rule_t *));
+}
+
+int tile_operand(ir_t *ir, int i) {
+  if (i == 0) {
+    return ir->a;
+  }
+  return ir->b;
+}
+
+// the constant an immediate operand stands for: a branch compares with 0
+int implicit_const(ir_t *ir) {
+  if (ir->op == IR_BR) {
+    return 0;
+  }
+  return ir->imm;
+}
+
+// whether operand i is a constant, left in tile_value
+bool operand_is_const(ir_t *ir, int i) {
+  int reg = tile_operand(ir, i);
+  ir_t *def;
+  if (!reg) {
+    tile_value = implicit_const(ir);
+    return 1;
+  }
+  def = tree_def(reg);
+  if (def && def->op == IR_CONST) {
+    tile_value = def->imm;
+    return 1;
+  }
+  return 0;
+}
+
+// the cost of deriving nt from operand i
+int operand_cost(ir_t *ir, int i, int nt) {
+  int reg = tile_operand(ir, i);
+  ir_t *def;
+  if (!reg) {
+    if (nt == NT_CONST || (nt == NT_IMM && is_imm12(implicit_const(ir)))) {
+      return 0;
+    } else if (nt == NT_REG || nt == NT_BYTE) {
+      return implicit_const(ir) != 0;
+    }
+    return TILE_INFINITY;
+  }
+  def = tree_def(reg);
+  if (def) {
+    return tile_costs[def->id * NT_COUNT + nt];
+  } else if (nt == NT_REG || nt == NT_ADDR || nt == NT_BYTE) {
+    return 0;
+  }
+  return TILE_INFINITY;
+}
+
+bool rule_applies(rule_t *rule, ir_t *ir) {
+  int cond = rule->cond;
+  ir_t *def;
+  if (cond == COND_ZERO) {
+    return ir->imm == 0;
+  } else if (cond == COND_IMM12 && ir->op == IR_ADDR_LOCAL) {
+    return is_imm12(frame_out_area + ir->imm);
+  } else if (cond == COND_IMM12) {
+    return is_imm12(ir->imm);
+  } else if (cond == COND_SIZE1) {
+    return ir->size == 1;
+  } else if (cond == COND_SIZE4) {
+    return ir->size == 4;
+  } else if (cond && !operand_is_const(ir, 1)) {
+    return 0;
+  } else if (cond == COND_B_ZERO) {
+    return tile_value == 0;
+  } else if (cond == COND_B_NEG12) {
+    return -2047 <= tile_value && tile_value <= 2048;
+  } else if (cond == COND_B_PLUS1) {
+    return -2049 <= tile_value && tile_value < 2047;
+  } else if (cond == COND_LOCAL_B) {
+    def = tree_def(ir->a);
+    return def && def->op == IR_ADDR_LOCAL && is_imm12(tile_value) &&
+           is_imm12(frame_out_area + def->imm + tile_value);
+  } else if (cond == COND_DIVISOR) {
+    return is_const_divisor(ir->op, tile_value);
+  }
+  return 1;
+}
+
+// strength reduction. a multiply by a constant becomes shifts and adds, a
+// division by a power of two a shift with the rounding toward zero fixed
+// up, and a division by another constant a multiply-high by its scaled
+// reciprocal as in Granlund and Montgomery, "Division by invariant integers
+// using multiplication". a sequence is counted before it is emitted, and
+// the selector weighs it against mul, div and rem at MUL_COST and DIV_COST
+
+bool seq_emit;  // emitting the sequence, not only counting it
+int seq_cost;   // of the sequence so far
+
+// each instruction of a sequence writes a new register, 0 when counting
+int seq_rri(char *op, int rs, int imm) {
+  int rd = 0;
+  seq_cost = seq_cost + 1;
+  if (seq_emit) {
+    rd = new_vreg();
+    insn_rri(op, rd, rs, imm);
+  }
+  return rd;
+}
+
+int seq_rrr(char *op, int rs1, int rs2) {
+  int rd = 0;
+  if (strcmp(op, "mulh") == 0 || strcmp(op, "mul") == 0) {
+    seq_cost = seq_cost + MUL_COST;
+  } else {
+    seq_cost = seq_cost + 1;
+  }
+  if (seq_emit) {
+    rd = new_vreg();
+    insn_rrr(op, rd, rs1, rs2);
+  }
+  return rd;
+}
+
+int seq_rr(char *op, int rs) {
+  int rd = 0;
+  seq_cost = seq_cost + 1;
+  if (seq_emit) {
+    rd = new_vreg();
+    insn_rr(op, rd, rs);
+  }
+  return rd;
+}
+
+int seq_li(int imm) {
+  int rd = 0;
+  seq_cost = seq_cost + 1;
+  if (seq_emit) {
+    rd = new_vreg();
+    insn_ri("li", rd, imm);
+  }
+  return rd;
+}
+
+// x * c from the non-adjacent form of c, whose digits are 0, 1 or -1 with
+// no two nonzero ones side by side: x * 7 is (x << 3) - x. the digits are
+// applied from the top as shift and add or subtract steps
+int seq_mul(int x, int c) {
+  int digits[32];
+  int n = 0;
+  int zeros = 0;
+  int shift = 0;
+  int r = x;
+  bool negate = c < 0;
+  if (c == 0) {
+    return REG_ZERO;
+  } else if (c == -2147483647 - 1) {
+    return seq_rri("slli", x, 31);
+  }
+  if (negate) {
+    c = -c;
+  }
+  while (c % 2 == 0) {
+    c = c / 2;
+    ++zeros;
+  }
+  while (c != 1) {
+    if (c % 2 == 0) {
+      digits[n] = 0;
+    } else if (c % 4 == 1 || c == 2147483647) {
+      digits[n] = 1;
+      c = c - 1;
+    } else {
+      digits[n] = -1;
+      c = c + 1;
+    }
+    c = c / 2;
+    ++n;
+  }
+  while (n) {
+    --n;
+    ++shift;
+    if (digits[n]) {
+      r = seq_rri("slli", r, shift);
+      if (digits[n] == 1) {
+        r = seq_rrr("add", r, x);
+      } else {
+        r = seq_rrr("sub", r, x);
+      }
+      shift = 0;
+    }
+  }
+  if (shift + zeros) {
+    r = seq_rri("slli", r, shift + zeros);
+  }
+  if (negate) {
+    r = seq_rr("neg", r);
+  }
+  return r;
+}
+
+// the cost of seq_mul(x, c), counted without emitting it
+int seq_mul_cost(int c) {
+  bool emit = seq_emit;
+  int cost = seq_cost;
+  int mul_cost;
+  seq_emit = 0;
+  seq_cost = 0;
+  seq_mul(0, c);
+  mul_cost = seq_cost;
+  seq_emit = emit;
+  seq_cost = cost;
+  return mul_cost;
+}
+
+// 2^k - 1 if x is negative, else 0: added to x before an arithmetic shift
+// by k, it makes the shift round toward zero as division does
+int seq_round_bias(int x, int k) {
+  int t;
+  if (k == 1) {
+    return seq_rri("srli", x, 31);
+  }
+  t = seq_rri("srai", x, 31);
+  return seq_rri("srli", t, 32 - k);
+}
+
+// the high word of x * m as unsigned numbers, without mulhu: the sum of
+// the products of 16-bit halves, each a shift and add sequence
+int seq_mulhu(int x, int m) {
+  int ml = m % 65536;
+  int mh = m / 65536;
+  int mask;
+  int xl;
+  int xh;
+  int lo;
+  int mid_l;
+  int mid_h;
+  int hi;
+  int t;
+  if (ml < 0) {
+    ml = ml + 65536;
+    mh = mh - 1;
+  }
+  if (mh < 0) {
+    mh = mh + 65536;
+  }
+  mask = seq_li(65535);
+  xl = seq_rrr("and", x, mask);
+  xh = seq_rri("srli", x, 16);
+  lo = seq_mul(xl, ml);
+  mid_l = seq_mul(xh, ml);
+  mid_h = seq_mul(xl, mh);
+  hi = seq_mul(xh, mh);
+  t = seq_rri("srli", lo, 16);
+  t = seq_rrr("add", t, seq_rrr("and", mid_l, mask));
+  t = seq_rrr("add", t, seq_rrr("and", mid_h, mask));
+  t = seq_rri("srli", t, 16);
+  hi = seq_rrr("add", hi, seq_rri("srli", mid_l, 16));
+  hi = seq_rrr("add", hi, seq_rri("srli", mid_h, 16));
+  return seq_rrr("add", hi, t);
+}
+
+// x / d for a d of 3 or more as the high word of x * m, with m the low 32
+// bits of 2^(31 + l) / d rounded up and l = ceil(log2 d). the multiply by
+// the missing bit 2^32 of m is the add of x. m is negative, and without M
+// the signed high word is the unsigned one less m if x is negative, less
+// x, which the add of x cancels
+int seq_div_magic(int x, int d, bool negate) {
+  int l = 0;
+  int p = 1;
+  int r = 1;
+  int q = 0;
+  int j;
+  int h;
+  int s;
+  while (l < 30 && p < d) {
+    p = p + p;
+    ++l;
+  }
+  if (p < d) {
+    l = 31;
+  }
+  // the quotient by long division, keeping the low 31 of its 32 bits.
+  // the remainder stays below d, and 2 * r is not formed as it may overflow
+  for (j = 30 + l; 0 <= j; --j) {
+    if (j < 31) {
+      q = q + q;
+    }
+    if (d - r <= r) {
+      r = r - (d - r);
+      if (j < 31) {
+        q = q + 1;
+      }
+    } else {
+      r = r + r;
+    }
+  }
+  s = seq_rri("srai", x, 31);
+  if (target_has_m) {
+    h = seq_rrr("mulh", x, seq_li(q - 2147483647));
+    h = seq_rrr("add", h, x);
+  } else {
+    h = seq_mulhu(x, q - 2147483647);
+    h = seq_rrr("sub", h, seq_rrr("and", s, seq_li(q - 2147483647)));
+  }
+  if (1 < l) {
+    h = seq_rri("srai", h, l - 1);
+  }
+  if (negate) {
+    return seq_rrr("sub", s, h);
+  }
+  return seq_rrr("sub", h, s);
+}
+
+int seq_div(int x, int d) {
+  int n = d;
+  int k;
+  int r = x;
+  if (d < 0) {
+    n = -d;
+  }
+  k = exact_log2(n);
+  if (k < 0) {
+    return seq_div_magic(x, n, d < 0);
+  } else if (k) {
+    r = seq_rrr("add", x, seq_round_bias(x, k));
+    r = seq_rri("srai", r, k);
+  }
+  if (d < 0) {
+    r = seq_rr("neg", r);
+  }
+  return r;
+}
+
+// x - x / d * d, where the sign of d does not matter. for a power of two
+// the multiply is a mask of the rounded x
+int seq_mod(int x, int d) {
+  int k;
+  int r;
+  if (d < 0) {
+    d = -d;
+  }
+  k = exact_log2(d);
+  if (k == 0) {
+    return REG_ZERO;
+  } else if (0 < k && k <= 11) {
+    r = seq_rrr("add", x, seq_round_bias(x, k));
+    r = seq_rri("andi", r, -d);
+  } else if (0 < k) {
+    r = seq_rrr("add", x, seq_round_bias(x, k));
+    r = seq_rrr("and", r, seq_li(-d));
+  } else if (!target_has_m || seq_mul_cost(d) < 1 + MUL_COST) {
+    r = seq_mul(seq_div_magic(x, d, 0), d);
+  } else {
+    r = seq_rrr("mul", seq_div_magic(x, d, 0), seq_li(d));
+  }
+  return seq_rrr("sub", x, r);
+}
+
+int seq_reduce(int emit, int x, int c) {
+  if (emit == EMIT_MUL_CONST) {
+    return seq_mul(x, c);
+  } else if (emit == EMIT_DIV_CONST) {
+    return seq_div(x, c);
+  }
+  return seq_mod(x, c);
+}
+
+int divisor_cost(int op, int d) {
+  seq_emit = 0;
+  seq_cost = 0;
+  if (op == IR_DIV) {
+    seq_div(0, d);
+  } else {
+    seq_mod(0, d);
+  }
+  return seq_cost;
+}
+
+// the cost of a rule for ir, which for a sequence depends on the constant
+int rule_cost(rule_t *rule, ir_t *ir) {
+  if (rule->emit != EMIT_MUL_CONST && rule->emit != EMIT_DIV_CONST &&
+      rule->emit != EMIT_MOD_CONST) {
+    return rule->cost;
+  }
+  operand_is_const(ir, 1);
+  seq_emit = 0;
+  seq_cost = 0;
+  seq_reduce(rule->emit, 0, tile_value);
+  if (!seq_cost) {
+    return 1;
+  }
+  return seq_cost;
+}
+
+// emits the sequence into rd, retargeting its last instruction
+void emit_sequence(int emit, int rd, int x, int c) {
+  int r;
+  seq_emit = 1;
+  seq_cost = 0;
+  r = seq_reduce(emit, x, c);
+  if (seq_cost) {
+    (insns + (insn_count - 1))->rd = rd;
+  } else {
+    insn_rr("mv", rd, r);
+  }
+}
+
+// finds the cheapest cover of the tree under ir for every nonterminal
+void label(ir_t *ir) {
+  int i;
+  int cost;
+  int n = ir_operand_count(ir);
+  int *costs = tile_costs + ir->id * NT_COUNT;
+  rule_t **rules = tile_rules + ir->id * NT_COUNT;
+  rule_t *rule;
+  ir_t *def;
+
+  for (i = 0; i < n; ++i) {
+    def = tree_def(ir_operand(ir, i));
+    if (def) {
+      label(def);
+    }
+  }
+  for (i = 0; i < NT_COUNT; ++i) {
+    costs[i] = TILE_INFINITY;
+  }
+  for (rule = op_rules[ir->op]; rule; rule = rule->next) {
+    if (rule->cond && !rule_applies(rule, ir)) {
+      continue;
+    }
+    cost = rule_cost(rule, ir);
+    if (rule->a != NT_NONE) {
+      cost = cost + operand_cost(ir, 0, rule->a);
+    }
+    if (rule->b != NT_NONE) {
+      cost = cost + operand_cost(ir, 1, rule->b);
+    }
+    if (cost < costs[rule->nt]) {
+      costs[rule->nt] = cost;
+      rules[rule->nt] = rule;
+    }
+  }
+  for (rule = chain_rules; rule; rule = rule->next) {
+    cost = costs[rule->a] + rule->cost;
+    if (cost < costs[rule->nt]) {
+      costs[rule->nt] = cost;
+      rules[rule->nt] = rule;
+    }
+  }
+}
+
+int reduce(ir_t *ir, int nt, int target);
+
+// emits operand i as nt, into target if that is a register. a load or
+// store adds its own offset to the displacement of its address
+int reduce_operand(ir_t *ir, int i, int nt, int target) {
+  int reg = tile_operand(ir, i);
+  ir_t *def = tree_def(reg);
+  if (def) {
+    reg = reduce(def, nt, target);
+  } else if (!reg) {
+    tile_imm = implicit_const(ir);
+    if (nt == NT_IMM || nt == NT_CONST || !tile_imm) {
+      return 0;
+    }
+    reg = new_vreg();
+    insn_ri("li", reg, tile_imm);
+  } else {
+    tile_imm = 0;
+  }
+  if (ir->op == IR_LOAD || ir->op == IR_STORE) {
+    tile_imm = tile_imm + ir->imm;
+  }
+  return reg;
+}
+
+// a base register whose tile_imm displacement fits an instruction
+int fit_address(int base) {
+  int reg;
+  if (is_imm12(tile_imm)) {
+    return base;
+  }
+  reg = new_vreg();
+  insn_ri("li", reg, tile_imm);
+  insn_rrr("add", reg, base, reg);
+  tile_imm = 0;
+  return reg;
+}
+
+// emits the cover of ir chosen for nt. a register result goes to target,
+// or the node's own register when target is 0, unless the cover passes an
+// operand on or uses the zero register. only the last instruction writes
+// the result, so target may also be read by the tree
+int reduce(ir_t *ir, int nt, int target) {
+  rule_t *rule = tile_rules[ir->id * NT_COUNT + nt];
+  int emit;
+  int a = 0;
+  int b = 0;
+  int a_imm = ir->imm;
+  int b_imm = 0;
+  int reg;
+  int tmp;
+  int before;
+
+  if (!rule || TILE_INFINITY <= tile_costs[ir->id * NT_COUNT + nt]) {
+    error("isel: no tile covers %s", ir_names[ir->op]);
+  }
+  if (!target) {
+    target = ir->dst;
+  }
+  emit = rule->emit;
+  if (!rule->op) {
+    a = reduce(ir, rule->a, 0);
+    a_imm = tile_imm;
+  } else if (rule->a != NT_NONE) {
+    if (emit == EMIT_MOVE) {
+      a = reduce_operand(ir, 0, rule->a, target);
+    } else {
+      a = reduce_operand(ir, 0, rule->a, 0);
+    }
+    a_imm = tile_imm;
+  }
+  if (rule->b != NT_NONE) {
+    b = reduce_operand(ir, 1, rule->b, 0);
+    b_imm = tile_imm;
+  }
+  before = insn_count;
+  reg = target;
+  if (rule->then) {
+    reg = new_vreg();
+  }
+  if (emit == EMIT_PASS) {
+    tile_imm = a_imm;
+    target = a;
+  } else if (emit == EMIT_ZERO) {
+    target = REG_ZERO;
+  } else if (emit == EMIT_IMM) {
+    tile_imm = ir->imm;
+    target = 0;
+  } else if (emit == EMIT_LI) {
+    insn_ri("li", reg, a_imm);
+  } else if (emit == EMIT_RR) {
+    insn_rr(rule->insn, reg, a);
+  } else if (emit == EMIT_RRR && rule->swap) {
+    insn_rrr(rule->insn, reg, b, a);
+  } else if (emit == EMIT_RRR) {
+    insn_rrr(rule->insn, reg, a, b);
+  } else if (emit == EMIT_RRI) {
+    insn_rri(rule->insn, reg, a, rule->sign * b_imm + rule->bias);
+  } else if (emit == EMIT_SEXT8) {
+    tmp = new_vreg();
+    insn_rri("slli", tmp, a, 24);
+    insn_rri("srai", reg, tmp, 24);
+  } else if (emit == EMIT_LOCAL) {
+    tile_imm = frame_out_area + ir->imm;
+    a = fit_address(REG_SP);
+    insn_rri(rule->insn, reg, a, tile_imm);
+  } else if (emit == EMIT_LA && ir->op == IR_ADDR_STRING) {
+    insn_load_address(reg, ".L.C", ir->imm, 0);
+  } else if (emit == EMIT_LA) {
+    insn_load_address(reg, NULL, 0, ir->name);
+  } else if (emit == EMIT_ADDR_LOCAL) {
+    tile_imm = frame_out_area + ir->imm;
+    target = REG_SP;
+  } else if (emit == EMIT_ADDR_ADD) {
+    tile_imm = b_imm;
+    target = a;
+  } else if (emit == EMIT_LOCAL_ADD) {
+    tmp = ir->a;
+    tile_imm = frame_out_area + tile_defs[tmp - VREG_BASE]->imm + b_imm;
+    target = REG_SP;
+  } else if (emit == EMIT_LOAD) {
+    tile_imm = a_imm;
+    a = fit_address(a);
+    insn_load(rule->insn, reg, tile_imm, a);
+  } else if (emit == EMIT_STORE) {
+    tile_imm = a_imm;
+    a = fit_address(a);
+    insn_store(rule->insn, b, tile_imm, a);
+  } else if (emit == EMIT_MOVE && a != target) {
+    insn_rr(rule->insn, target, a);
+  } else if (emit == EMIT_MUL_CONST || emit == EMIT_DIV_CONST ||
+             emit == EMIT_MOD_CONST) {
+    emit_sequence(emit, reg, a, b_imm);
+  }
+  if (rule->then == THEN_INVERT) {
+    insn_rri("xori", target, reg, 1);
+  } else if (rule->then == THEN_SEQZ) {
+    insn_rr("seqz", target, reg);
+  } else if (rule->then == THEN_SNEZ) {
+    insn_rr("snez", target, reg);
+  }
+  if (ir->in_tree && ir->comment && rule->op) {
+    if (insn_count != before) {
+      insn_comment(ir->comment, ir->comment_name);
+    } else {
+      tile_comment_ir = ir;
+    }
+  }
+  if (nt == NT_REG || nt == NT_BYTE) {
+    tile_imm = 0;
+  }
+  return target;
+}
+
+// an operand of an instruction the grammar does not cover, in a register,
+// which is target if that is not 0
+int select_operand(int reg, int target) {
+  ir_t *def = tree_def(reg);
+  if (def) {
+    label(def);
+    reg = reduce(def, NT_REG, target);
+  }
+  if (target && reg != target) {
+    insn_rr("mv", target, reg);
+    return target;
+  }
+  return reg;
+}
+
+// the first MAX_REG_ARGS arguments are passed in a0-a7, the rest on the
+// stack from 0(sp) at the call, as in the ilp32 calling convention
+const int MAX_REG_ARGS = 8;
+
+// the order an argument is moved into its register in: values already in a
+// register first, which ends their live ranges and lets the result of a call
+// just before go straight to its argument register, then the trees, and the
+// constants and addresses, which need no register at all, last
+int arg_order(int reg) {
+  ir_t *def = tree_def(reg);
+  if (!def) {
+    return 0;
+  }
+  if (def->op == IR_CONST || def->op == IR_ADDR_LOCAL ||
+      def->op == IR_ADDR_GLOBAL || def->op == IR_ADDR_STRING) {
+    return 2;
+  }
+  return 1;
+}
+
+// arguments are evaluated straight into their argument registers. the
+// allocator never hands out a0-a7, so evaluating one argument cannot clobber
+// another, and the order only decides how long the operands stay live
+void select_call(ir_t *ir) {
+  int i;
+  int order;
+  int reg_args = ir->arg_count;
+  int stack_args = 0;
+  int reg;
+  insn_t *insn;
+
+  if (MAX_REG_ARGS < reg_args) {
+    reg_args = MAX_REG_ARGS;
+    stack_args = ir->arg_count - MAX_REG_ARGS;
+  }
+  for (i = 0; i < stack_args; ++i) {
+    reg = select_operand(ir->args[MAX_REG_ARGS + i], 0);
+    insn_store("sw", reg, 4 * i, REG_SP);
+  }
+  for (order = 0; order < 3; ++order) {
+    for (i = 0; i < reg_args; ++i) {
+      if (arg_order(ir->args[i]) == order) {
+        select_operand(ir->args[i], REG_A0 + i);
+      }
+    }
+  }
+  if (ir->tail) {
+    insn = new_insn(INSN_TAIL, "tail");
+  } else {
+    insn = new_insn(INSN_CALL, "call");
+  }
+  insn->name = ir->name;
+  insn->imm = stack_args;
+  if (ir->dst && !ir->tail) {
+    insn_rr("mv", ir->dst, REG_A0);
+  }
+}
+
+// a compare-and-branch to one target, falling through to the other when it
+// is `next`, the block laid out after the one of ir
+void select_branch(ir_t *ir, ir_block_t *next) {
+  int cond = ir->imm;
+  int a = select_operand(ir->a, 0);
+  int b = 0;
+  ir_block_t *target = ir->target;
+  ir_block_t *other = ir->target_else;
+  if (ir->b) {
+    b = select_operand(ir->b, 0);
+  }
+  if (target == next) {
+    cond = ir_negated[cond];
+    target = other;
+    other = next;
+  }
+  if (b) {
+    insn_branch(ir_branch_ops[cond], a, b, target->prefix, target->index);
+  } else {
+    insn_branch(ir_branch_zero_ops[cond], a, 0, target->prefix,
+                target->index);
+  }
+  if (other != next) {
+    insn_jump(other->prefix, other->index);
+  }
+}
+
+// the root of a tree, whose result goes to its own register
+void select_tree(ir_t *ir) {
+  int reg;
+  label(ir);
+  if (ir->op == IR_STORE) {
+    reduce(ir, NT_STMT, 0);
+    return;
+  }
+  reg = reduce(ir, NT_REG, ir->dst);
+  if (reg != ir->dst) {
+    insn_rr("mv", ir->dst, reg);
+  }
+}
+
+void select_ir(ir_t *ir, ir_block_t *next) {
+  int op = ir->op;
+  if (op == IR_PARAM) {
+    insn_rr("mv", ir->dst, REG_A0 + ir->imm);
+  } else if (op == IR_CALL) {
+    select_call(ir);
+  } else if (op == IR_JMP) {
+    if (ir->target != next) {
+      insn_jump(ir->target->prefix, ir->target->index);
     }
-    gen_push("t0");
-  } else if (node->kind == NODE_ARROW) {
-    gen(node->lhs);
-    gen_pop("t0");
-    if (node->type->ty != TYPE_ARRAY) {
-      if (node->rhs->offset < 2048) {
-        printf("%slw t0, %d(t0)\n", indent, node->rhs->offset);
-      } else {
-        printf("%sli  t1, %d\n", indent, node->rhs->offset);
-        printf("%sadd t0, t0, t1\n", indent);
-        printf("%slw t0, 0(t0)\n", indent);
+  } else if (op == IR_BR) {
+    select_branch(ir, next);
+  } else if (op == IR_RET && ir->tail) {
+    // the callee returns for the function
+  } else if (op == IR_RET) {
+    if (ir->a) {
+      select_operand(ir->a, REG_A0);
+    }
+    new_insn(INSN_RET, "ret");
+  } else {
+    select_tree(ir);
+  }
+}
+
+// a call whose result the function returns right away becomes a jump to the
+// callee once the frame is torn down, and the callee returns to our caller.
+// not with stack arguments, which the frame of our caller has no room for,
+// nor with locals in memory, which an argument could point to
+void mark_tail_calls() {
+  int i;
+  ir_t *ir;
+  ir_t *call;
+  if (locals_size) {
+    return;
+  }
+  for (i = 0; i < block_count; ++i) {
+    call = NULL;
+    for (ir = blocks[i]->first; ir->next; ir = ir->next) {
+      call = ir;
+    }
+    if (ir->op == IR_RET && call && call->op == IR_CALL &&
+        call->arg_count <= MAX_REG_ARGS && (!ir->a || ir->a == call->dst)) {
+      call->tail = 1;
+      ir->tail = 1;
+    }
+  }
+}
+
+void select_insns() {
+  int i;
+  ir_block_t *block;
+  ir_block_t *next;
+  ir_t *ir;
+  frame_out_area = 0;
+  for (i = 0; i < block_count; ++i) {
+    for (ir = blocks[i]->first; ir; ir = ir->next) {
+      if (ir->op == IR_CALL &&
+          frame_out_area < 4 * (ir->arg_count - MAX_REG_ARGS)) {
+        frame_out_area = 4 * (ir->arg_count - MAX_REG_ARGS);
       }
-    } else {
-      if (node->rhs->offset < 2048) {
-        printf("%saddi t0, t0, %d\n", indent, node->rhs->offset);
-      } else {
-        printf("%sli  t1, %d\n", indent, node->rhs->offset);
-        printf("%sadd t0, t0, t1\n", indent);
+    }
+  }
+  mark_trees();
+  mark_tail_calls();
+  for (i = 0; i < block_count; ++i) {
+    block = blocks[i];
+    next = NULL;
+    if (i + 1 < block_count) {
+      next = blocks[i + 1];
+    }
+    if (block->prefix) {
+      depth = block->first->depth;
+      insn_label(block->prefix, block->index, block->comment);
+    }
+    for (ir = block->first; ir; ir = ir->next) {
+      if (ir->in_tree) {
+        continue;
+      }
+      depth = ir->depth;
+      tile_comment_ir = NULL;
+      select_ir(ir, next);
+      if (ir->comment) {
+        insn_comment(ir->comment, ir->comment_name);
+      } else if (tile_comment_ir) {
+        insn_comment(tile_comment_ir->comment,
+                     tile_comment_ir->comment_name);
       }
     }
-    gen_push("t0");
-  } else if (node->kind == NODE_ASSIGN) {
-    gen(node->rhs);
-    gen_lval(node->lhs);
-    gen_pop("t1");  // address
-    gen_pop("t0");  // value
-
-    if (calc_size_of_type(node->type) == 4) {
-      printf("%ssw t0, 0(t1)\n", indent);
-    } else if (calc_size_of_type(node->type) == 1) {
-      printf("%sandi t0, t0, 0xFF\n", indent);
-      printf("%ssb t0, 0(t1)\n", indent);
-    } else {
-      error("invalid size of type: %zd\n", calc_size_of_type(node->type));
-    }
-    gen_push("t0");                         // value again
-  } else if (node->kind == NODE_VAR_DEC) {  // almost same as NODE_ASSIGN
-    if (node->rhs && node->lhs) {
-      gen(node->rhs);
-      gen_lval(node->lhs);
-      gen_pop("t1");  // address
-      gen_pop("t0");  // value
-
-      if (calc_size_of_type(node->type) == 4) {
-        printf("%ssw t0, 0(t1)\n", indent);
-      } else if (calc_size_of_type(node->type) == 1) {
-        printf("%sandi t0, t0, 0xFF\n", indent);
-        printf("%ssb t0, 0(t1)\n", indent);
-      } else {
-        error("invalid size of type: %zd\n", calc_size_of_type(node->type));
+  }
+}
+
+// peephole optimization of insns[], once on virtual registers before they
+// are allocated and once after. each rule names the forms and mnemonics of
+// an instruction and the one after it; its action checks the rest and
+// rewrites them. rules are tried in order at every position
+const int PEEP_COPY_INTO_DEF = 1;     // op t, ...; mv x, t => op x, ...
+const int PEEP_COPY_INTO_USE = 2;     // mv t, x; op ..., t => op ..., x
+const int PEEP_STORE_LOAD = 3;        // sw x, o(b); lw y, o(b) => mv y, x
+const int PEEP_JUMP_TO_NEXT = 4;      // j L; L:
+const int PEEP_BRANCH_OVER_JUMP = 5;  // bcc L1; j L2; L1: => b!cc L2; L1:
+const int PEEP_THREAD = 6;            // to L, where L: j L2 => to L2
+const int PEEP_UNREACHABLE = 7;       // after a jump, up to the next label
+const int PEEP_SELF_MOVE = 8;         // mv r, r once registers are physical
+
+struct peephole_rule_t {
+  char *name;
+  int action;        // PEEP_*
+  bool after_alloc;  // runs on physical registers
+  int form;          // of the instruction, 0 for any
+  char *op;          // its mnemonic, NULL for any
+  int next_form;     // of the instruction after it, 0 for any
+  char *next_op;
+  int fired;
+  struct peephole_rule_t *next;
+};
+typedef struct peephole_rule_t peephole_rule_t;
+
+peephole_rule_t *peephole_rules;
+// the rules that may match each form, in order, from peep_first[form] up
+// to peep_end[form]
+#define PEEP_TABLE_SIZE 256
+peephole_rule_t *peep_table[PEEP_TABLE_SIZE];
+int peep_first[INSN_FORM_COUNT];
+int peep_end[INSN_FORM_COUNT];
+int *peep_uses;  // by vreg, before allocation
+int *peep_defs;
+int *peep_jump_labels;  // positions of labels followed by a jump
+int peep_jump_label_count;
+
+void add_peephole_rule(char *name, int action, bool after_alloc, int form,
+                       char *op, int next_form, char *next_op) {
+  peephole_rule_t *rule = calloc(1, sizeof(peephole_rule_t));
+  peephole_rule_t *last = peephole_rules;
+  rule->name = name;
+  rule->action = action;
+  rule->after_alloc = after_alloc;
+  rule->form = form;
+  rule->op = op;
+  rule->next_form = next_form;
+  rule->next_op = next_op;
+  if (!last) {
+    peephole_rules = rule;
+    return;
+  }
+  while (last->next) {
+    last = last->next;
+  }
+  last->next = rule;
+}
+
+void index_peephole_rules() {
+  int form;
+  int n = 0;
+  peephole_rule_t *rule;
+  for (form = 0; form < INSN_FORM_COUNT; ++form) {
+    peep_first[form] = n;
+    for (rule = peephole_rules; rule; rule = rule->next) {
+      if (rule->form == 0 || rule->form == form) {
+        if (n == PEEP_TABLE_SIZE) {
+          error("too many peephole rules");
+        }
+        peep_table[n] = rule;
+        ++n;
       }
-      // not push value because it is not used
     }
-  } else if (node->kind == NODE_RETURN) {
-    if (node->rhs) {
-      gen(node->rhs);
-      gen_pop("a0");
+    peep_end[form] = n;
+  }
+}
+
+void init_peephole() {
+  add_peephole_rule("copy-into-def", PEEP_COPY_INTO_DEF, 0, 0, NULL, INSN_RR,
+                    "mv");
+  add_peephole_rule("copy-into-use", PEEP_COPY_INTO_USE, 0, INSN_RR, "mv", 0,
+                    NULL);
+  add_peephole_rule("store-load", PEEP_STORE_LOAD, 0, INSN_STORE, "sw",
+                    INSN_LOAD, "lw");
+  add_peephole_rule("thread-jump", PEEP_THREAD, 0, INSN_JUMP, NULL, 0, NULL);
+  add_peephole_rule("thread-branch", PEEP_THREAD, 0, INSN_BRANCH, NULL, 0,
+                    NULL);
+  add_peephole_rule("branch-over-jump", PEEP_BRANCH_OVER_JUMP, 0,
+                    INSN_BRANCH, NULL, INSN_JUMP, NULL);
+  add_peephole_rule("jump-to-next", PEEP_JUMP_TO_NEXT, 0, INSN_JUMP, NULL,
+                    INSN_LABEL, NULL);
+  add_peephole_rule("unreachable", PEEP_UNREACHABLE, 0, INSN_JUMP, NULL, 0,
+                    NULL);
+  add_peephole_rule("self-move", PEEP_SELF_MOVE, 1, INSN_RR, "mv", 0, NULL);
+  index_peephole_rules();
+}
+
+// the next instruction not deleted, insn_count if there is none.
+// deleted instructions have form 0 until the pass compacts insns[]
+int peep_next(int i) {
+  insn_t *insn;
+  for (++i; i < insn_count; ++i) {
+    insn = insns + i;
+    if (insn->form) {
+      break;
     }
-    gen_free_stack(local_variables);
-    gen_pop("fp");
-    printf("%sret\n", indent);
-  } else if (node->kind == NODE_BREAK) {
-    printf("%sj .L.loop.end%d\n", indent, last_loop_label_index);
-  } else if (node->kind == NODE_CONTINUE) {
-    printf("%sj .L.loop.next%d\n", indent, last_loop_label_index);
-  } else if (node->kind == NODE_IF) {
-    gen(node->cond);
-    gen_pop("t0");
-    index = gen_label_index();
-    printf("%sbeqz t0, .L.else%d\n", indent, index);
-    gen(node->clause_then);
-    printf("%sj .L.if.end%d\n", indent, index);
-    printf(".L.else%d:\n", index);
-    if (node->clause_else) {
-      gen(node->clause_else);
+  }
+  return i;
+}
+
+bool is_same_label(insn_t *insn, char *prefix, int index) {
+  return insn->form == INSN_LABEL && insn->index == index &&
+         strcmp(insn->prefix, prefix) == 0;
+}
+
+// a temporary defined and read once, which a rewrite may remove
+bool is_peep_temp(int reg) {
+  int v = reg - VREG_BASE;
+  return variable_vreg_count <= v && peep_defs[v] == 1 && peep_uses[v] == 1;
+}
+
+// the register allocated to reg, 0 if it is spilled
+int physical_reg(int reg) {
+  if (reg < VREG_BASE) {
+    return reg;
+  }
+  return vreg_reg[reg - VREG_BASE];
+}
+
+// the mnemonic of the branch taken when op is not
+char *negate_branch(char *op) {
+  int cond;
+  for (cond = IR_LT; cond <= IR_NE; ++cond) {
+    if (strcmp(op, ir_branch_ops[cond]) == 0) {
+      return ir_branch_ops[ir_negated[cond]];
+    } else if (strcmp(op, ir_branch_zero_ops[cond]) == 0) {
+      return ir_branch_zero_ops[ir_negated[cond]];
     }
-    printf(".L.if.end%d:\n", index);
-  } else if (node->kind == NODE_WHILE) {
-    old_loop_label_index = last_loop_label_index;
-    index = gen_loop_label_index();
-    printf(".L.loop.cond%d: # while loop start\n", index);
-    gen(node->cond);
-    gen_pop("t0");
-    printf("%sbeqz t0, .L.loop.end%d\n", indent, index);
-    gen(node->clause_then);
-    printf(".L.loop.next%d: # while loop next (empty)\n",
-           index);  // empty, but needed for break/continue
-    printf("%sj .L.loop.cond%d\n", indent, index);
-    printf(".L.loop.end%d: # while loop end\n", index);
-    last_loop_label_index = old_loop_label_index;
-  } else if (node->kind == NODE_FOR) {
-    old_loop_label_index = last_loop_label_index;
-    index = gen_loop_label_index();
-    printf("%s# for start\n", indent);
-    if (node->init) {
-      printf("%s# for init\n", indent);
-      gen(node->init);
-    } else {
-      printf("%s# for init: empty\n", indent);
+  }
+  error("peephole: unknown branch %s", op);
+  return NULL;
+}
+
+// the jump right after the label prefix index, if there is one
+insn_t *find_jump_label(char *prefix, int index) {
+  int i;
+  insn_t *label;
+  for (i = 0; i < peep_jump_label_count; ++i) {
+    label = insns + peep_jump_labels[i];
+    if (is_same_label(label, prefix, index)) {
+      return insns + peep_next(peep_jump_labels[i]);
     }
-    printf(".L.loop.cond%d: # for cond\n", index);
-    if (node->cond) {
-      printf("%s# for cond\n", indent);
-      gen(node->cond);
-      gen_pop("t0");
-      printf("%sbeqz t0, .L.loop.end%d\n", indent, index);
+  }
+  return NULL;
+}
+
+// applies rule at insns[i], whose next instruction is insns[j]
+bool apply_peephole(peephole_rule_t *rule, int i, int j) {
+  int action = rule->action;
+  int k;
+  insn_t *insn = insns + i;
+  insn_t *next = insns + j;
+  insn_t *jump;
+
+  if (action == PEEP_COPY_INTO_DEF) {
+    if (!insn_def(insn) || next->rs1 != insn->rd || !is_peep_temp(insn->rd)) {
+      return 0;
+    }
+    insn->rd = next->rd;
+    next->form = 0;
+  } else if (action == PEEP_COPY_INTO_USE) {
+    if (insn->rd < VREG_BASE || !is_peep_temp(insn->rd)) {
+      return 0;
+    }
+    if (insn_use1(next) == insn->rd) {
+      next->rs1 = insn->rs1;
+    } else if (insn_use2(next) == insn->rd &&
+               (next->form != INSN_BRANCH || insn->rs1 != REG_ZERO)) {
+      next->rs2 = insn->rs1;
     } else {
-      printf("%s# for cond: empty\n", indent);
+      return 0;
     }
-    printf("%s# for body\n", indent);
-    gen(node->clause_then);
-    printf(".L.loop.next%d: # for next\n", index);
-    if (node->next) {
-      gen(node->next);
+    insn->form = 0;
+  } else if (action == PEEP_STORE_LOAD) {
+    if (next->rs1 != insn->rs1 || next->imm != insn->imm) {
+      return 0;
     }
-    printf("%sj .L.loop.cond%d\n", indent, index);
-    printf(".L.loop.end%d: # for end\n", index);
-    last_loop_label_index = old_loop_label_index;
-  } else if (node->kind == NODE_BLOCK) {
-    for (i = 0; i < node->statement_count; ++i) {
-      gen(node->statements[i]);
+    next->form = INSN_RR;
+    next->op = "mv";
+    next->rs1 = insn->rs2;
+  } else if (action == PEEP_JUMP_TO_NEXT) {
+    if (!is_same_label(next, insn->prefix, insn->index)) {
+      return 0;
     }
-  } else if (node->kind == NODE_CALL) {
-    name = calloc(node->name->len + 1, 1);
-    memcpy(name, node->name->str, node->name->len);
-
-    for (i = 0; i < node->args_count; ++i) {
-      gen(node->args[node->args_count - 1 - i]);
-    }
-    for (i = 0; i < node->args_count; ++i) {
-      s[0] = 'a';
-      s[1] = '0';
-      s[2] = '\0';
-      s[1] = 48 + i;
-      gen_pop(s);
-    }
-
-    // stack aligned 16
-    gen_push("ra");
-    gen_push("s1");
-    printf("%sandi s1, sp, 0xF\n", indent);  // s1 = SP & 0xF
-    printf("%ssub  sp, sp, s1\n", indent);   // align SP
-    printf("%scall %s\n", indent, name);
-    printf("%sadd  sp, sp, s1\n", indent);  // recover SP
-    gen_pop("s1");
-    gen_pop("ra");
-    gen_push("a0");
-  } else if (node->kind == NODE_ADDR) {
-    gen_lval(node->rhs);
-  } else if (node->kind == NODE_DEREF) {
-    gen(node->rhs);
-    gen_pop("t0");
-    if (calc_size_of_type(node->type) == 4) {
-      printf("%slw t0, 0(t0)\n", indent);
-    } else if (calc_size_of_type(node->type) == 1) {
-      printf("%slb t0, 0(t0)\n", indent);
-    } else {
-      error("invalid size of type: %zd\n", calc_size_of_type(node->type));
+    insn->form = 0;
+  } else if (action == PEEP_BRANCH_OVER_JUMP) {
+    k = peep_next(j);
+    if (insn_count <= k ||
+        !is_same_label(insns + k, insn->prefix, insn->index)) {
+      return 0;
     }
-    gen_push("t0");
-  } else {
-    error("gen invalid node, kind=%d", node->kind);
+    insn->op = negate_branch(insn->op);
+    insn->prefix = next->prefix;
+    insn->index = next->index;
+    next->form = 0;
+  } else if (action == PEEP_THREAD) {
+    jump = find_jump_label(insn->prefix, insn->index);
+    if (!jump || jump == insn || (jump->prefix == insn->prefix &&
+                                  jump->index == insn->index)) {
+      return 0;
+    }
+    insn->prefix = jump->prefix;
+    insn->index = jump->index;
+  } else if (action == PEEP_UNREACHABLE) {
+    if (j == insn_count || next->form == INSN_LABEL) {
+      return 0;
+    }
+    while (j < insn_count && next->form != INSN_LABEL) {
+      next->form = 0;
+      j = peep_next(j);
+      next = insns + j;
+    }
+  } else if (action == PEEP_SELF_MOVE) {
+    if (!physical_reg(insn->rd) ||
+        physical_reg(insn->rd) != physical_reg(insn->rs1)) {
+      return 0;
+    }
+    insn->form = 0;
   }
-  if (node->ignore) {
-    gen_pop("zero");
+  ++rule->fired;
+  return 1;
+}
+
+void count_peep_registers() {
+  int i;
+  insn_t *insn;
+  peep_uses = arena_alloc(function_arena, (vreg_count + 1) * sizeof(int));
+  peep_defs = arena_alloc(function_arena, (vreg_count + 1) * sizeof(int));
+  for (i = 0; i < insn_count; ++i) {
+    insn = insns + i;
+    if (VREG_BASE <= insn_use1(insn)) {
+      ++peep_uses[insn_use1(insn) - VREG_BASE];
+    }
+    if (VREG_BASE <= insn_use2(insn)) {
+      ++peep_uses[insn_use2(insn) - VREG_BASE];
+    }
+    if (VREG_BASE <= insn_def(insn)) {
+      ++peep_defs[insn_def(insn) - VREG_BASE];
+    }
   }
-  dec_depth();
+}
+
+void peephole(bool after_alloc) {
+  int i;
+  int j;
+  int k;
+  int n = 0;
+  insn_t *insn;
+  insn_t *next;
+  peephole_rule_t *rule;
+
+  if (!after_alloc) {
+    count_peep_registers();
+  }
+  peep_jump_labels = arena_alloc(function_arena, insn_count * sizeof(int));
+  peep_jump_label_count = 0;
+  for (i = 0; i + 1 < insn_count; ++i) {
+    insn = insns + i;
+    if (insn->form == INSN_LABEL && (insn + 1)->form == INSN_JUMP) {
+      peep_jump_labels[peep_jump_label_count] = i;
+      ++peep_jump_label_count;
+    }
+  }
+  for (i = 0; i < insn_count; ++i) {
+    insn = insns + i;
+    for (k = peep_first[insn->form]; k < peep_end[insn->form]; ++k) {
+      rule = peep_table[k];
+      if (!insn->form) {
+        break;
+      } else if (rule->after_alloc != after_alloc ||
+                 (rule->op && strcmp(insn->op, rule->op) != 0)) {
+        continue;
+      }
+      j = peep_next(i);
+      if (rule->next_form || rule->next_op) {
+        next = insns + j;
+        if (j == insn_count ||
+            (rule->next_form && next->form != rule->next_form) ||
+            (rule->next_op && strcmp(next->op, rule->next_op) != 0)) {
+          continue;
+        }
+      }
+      apply_peephole(rule, i, j);
+    }
+  }
+  for (i = 0; i < insn_count; ++i) {
+    insn = insns + i;
+    if (insn->form) {
+      memcpy(insns + n, insn, sizeof(insn_t));
+      ++n;
+    }
+  }
+  insn_count = n;
+}
+
+void print_peephole_stats(char *path) {
+  peephole_rule_t *rule;
+  if (!path) {
+    path = "<stdin>";
+  }
+  for (rule = peephole_rules; rule; rule = rule->next) {
+    eprintf("peephole %s: %s %d\n", path, rule->name, rule->fired);
+  }
+}
+
+// ".globl name" and friends
+void emit_symbol_directive(char *directive, int name) {
+  emit_directive(directive);
+  emit_char(' ');
+  emit_ident(name);
 }
 
 void print_func_prologue(declaration_t *dec) {
   size_t i;
-  char reg[3];
-  local_variable_t *var;
-  printf("  .text\n");
-  printf("  .align 4\n");
-  printf("  .globl    %.*s\n", dec->name->len, dec->name->str);
-  printf("  .type	    %.*s, @function\n", dec->name->len, dec->name->str);
-  printf("%.*s:\n", dec->name->len, dec->name->str);
-  gen_push("fp");  // save fp
+  int reg;
+  int stack_arg_offset;
+  emit_directive(".text");
+  emit_eol();
+  emit_directive(".align 4");
+  emit_eol();
+  if (!dec->is_static) {
+    emit_symbol_directive(".globl", dec->name);
+    emit_eol();
+  }
+  emit_symbol_directive(".type", dec->name);
+  emit_str(", @function");
+  emit_eol();
+  emit_ident(dec->name);
+  emit_char(':');
+  emit_eol();
+  layout_frame();
+  if (!frame_total) {
+    return;
+  }
+  emit_move_sp(-frame_total, "stack alloc");
+  if (frame_saves_ra) {
+    emit_rm("sw", REG_RA, frame_total - 4, REG_SP);
+  }
+  for (i = ALLOC_FIRST_CALLEE_SAVED; i < ALLOC_REG_COUNT; ++i) {
+    reg = alloc_regs[i];
+    if (0 <= saved_reg_offset[reg]) {
+      emit_rm("sw", reg, frame_out_area + saved_reg_offset[reg], REG_SP);
+    }
+  }
 
-  gen_alloc_stack(local_variables);
-  printf("%smv   fp, sp\n", indent);  // update fp
+  // push arguments, unless they are kept in registers
+  for (i = 0; i < dec->func_arg_count && i < MAX_REG_ARGS; ++i) {
+    if (trace_gen) {
+      eprintf("push arg a%zd\n", i);
+    }
+    if (!dec->func_args[i]->reg) {
+      emit_rm("sw", REG_A0 + i, frame_out_area + dec->func_args[i]->offset,
+              REG_SP);
+    }
+  }
+  // stack arguments are where sp was at the call
+  stack_arg_offset = frame_total;
+  for (; i < dec->func_arg_count; ++i) {
+    emit_rm("lw", REG_T0, stack_arg_offset, REG_SP);
+    emit_rm("sw", REG_T0, frame_out_area + dec->func_args[i]->offset,
+            REG_SP);
+    stack_arg_offset = stack_arg_offset + 4;
+  }
+}
 
-  // push arguments
-  for (i = 0; i < dec->func_arg_count; ++i) {
-    reg[0] = 'a';
-    reg[1] = '0';
-    reg[2] = '\0';
-    var = find_local_variable(dec->func_arg[i]);
-    reg[1] = reg[1] + i;
-    eprintf("push arg %s\n", reg);
-    printf("%ssw %s, %d(fp)\n", indent, reg, var->offset);
+// restores the registers and sp the function was entered with
+void print_free_frame() {
+  int i;
+  int reg;
+  for (i = ALLOC_FIRST_CALLEE_SAVED; i < ALLOC_REG_COUNT; ++i) {
+    reg = alloc_regs[i];
+    if (0 <= saved_reg_offset[reg]) {
+      emit_rm("lw", reg, frame_out_area + saved_reg_offset[reg], REG_SP);
+    }
+  }
+  if (frame_saves_ra) {
+    emit_rm("lw", REG_RA, frame_total - 4, REG_SP);
+  }
+  if (frame_total) {
+    emit_move_sp(frame_total, "stack free");
+  }
+}
+
+void print_func_epilogue() {
+  print_free_frame();
+  emit_insn("ret");
+  emit_eol();
+}
+
+// the stack arguments are already at 0(sp), in the frame of the caller
+void print_call(insn_t *insn) {
+  emit_insn(insn->op);
+  emit_operand_separator();
+  emit_ident(insn->name);
+  emit_eol();
+}
+
+// the physical register to read `reg` from. a spilled register is loaded
+// into `scratch` first
+int use_operand(int reg, int scratch) {
+  int v = reg - VREG_BASE;
+  if (reg < VREG_BASE) {
+    return reg;
+  }
+  if (vreg_reg[v]) {
+    return vreg_reg[v];
+  }
+  emit_rm("lw", scratch, frame_out_area + vreg_slot[v], REG_SP);
+  return scratch;
+}
+
+// the physical register to write `reg` to; t5 for a spilled one, which is
+// stored by store_operand() after the instruction
+int def_operand(int reg) {
+  if (reg < VREG_BASE) {
+    return reg;
+  }
+  if (vreg_reg[reg - VREG_BASE]) {
+    return vreg_reg[reg - VREG_BASE];
+  }
+  return REG_T5;
+}
+
+void store_operand(int reg) {
+  int v = reg - VREG_BASE;
+  if (VREG_BASE <= reg && !vreg_reg[v]) {
+    emit_rm("sw", REG_T5, frame_out_area + vreg_slot[v], REG_SP);
+  }
+}
+
+void print_insns() {
+  int i;
+  int form;
+  int rd;
+  int rs1;
+  int rs2;
+  insn_t *insn;
+
+  for (i = 0; i < insn_count; ++i) {
+    insn = insns + i;
+    form = insn->form;
+    if (insn->depth != depth) {
+      depth = insn->depth;
+      if (!emit_compact) {
+        update_indent();
+      }
+    }
+    if (form == INSN_LABEL) {
+      emit_label(insn->prefix, insn->index, insn->comment);
+      continue;
+    } else if (form == INSN_CALL) {
+      print_call(insn);
+      continue;
+    } else if (form == INSN_TAIL) {
+      print_free_frame();
+      print_call(insn);
+      continue;
+    } else if (form == INSN_RET) {
+      print_func_epilogue();
+      continue;
+    }
+
+    rs1 = use_operand(insn_use1(insn), REG_T5);
+    rs2 = use_operand(insn_use2(insn), REG_T6);
+    rd = def_operand(insn_def(insn));
+    if (form == INSN_LA) {
+      emit_load_address(rd, insn->prefix, insn->index, insn->name);
+      store_operand(insn->rd);
+      continue;
+    }
+    emit_insn(insn->op);
+    if (form == INSN_RRR) {
+      emit_reg(rd);
+      emit_reg(rs1);
+      emit_reg(rs2);
+    } else if (form == INSN_RRI) {
+      emit_reg(rd);
+      emit_reg(rs1);
+      emit_imm(insn->imm);
+    } else if (form == INSN_RR) {
+      emit_reg(rd);
+      emit_reg(rs1);
+    } else if (form == INSN_RI) {
+      emit_reg(rd);
+      emit_imm(insn->imm);
+    } else if (form == INSN_LOAD) {
+      emit_reg(rd);
+      emit_mem(insn->imm, rs1);
+    } else if (form == INSN_STORE) {
+      emit_reg(rs2);
+      emit_mem(insn->imm, rs1);
+    } else if (form == INSN_BRANCH) {
+      emit_reg(rs1);
+      if (insn->rs2) {
+        emit_reg(rs2);
+      }
+      emit_label_ref(insn->prefix, insn->index);
+    } else if (form == INSN_JUMP) {
+      emit_label_ref(insn->prefix, insn->index);
+    }
+    if (insn->comment) {
+      if (insn->comment_name) {
+        emit_comment_ident(insn->comment, insn->comment_name);
+      } else {
+        emit_comment(insn->comment);
+      }
+    }
+    emit_eol();
+    store_operand(insn_def(insn));
+  }
+}
+
+// marks the local variables whose address is taken
+void find_escaping_locals(node_t *node) {
+  int i;
+  if (!node) {
+    return;
+  }
+  if (node->kind == NODE_ADDR && node->rhs->kind == NODE_LOCAL_VARIABLE) {
+    node->rhs->local->escapes = 1;
+  }
+  find_escaping_locals(node->lhs);
+  find_escaping_locals(node->rhs);
+  find_escaping_locals(node->cond);
+  find_escaping_locals(node->clause_then);
+  find_escaping_locals(node->clause_else);
+  find_escaping_locals(node->init);
+  find_escaping_locals(node->next);
+  for (i = 0; i < node->child_count; ++i) {
+    find_escaping_locals(node->children[i]);
+  }
+}
+
+// scalar locals whose address is never taken live in virtual registers
+// instead of the frame. parameters passed in registers are moved there on
+// entry; those passed on the stack stay in memory.
+void promote_locals(declaration_t *dec) {
+  local_variable_t *var;
+  size_t i;
+  ir_t *ir;
+  for (i = 0; i < dec->func_statement_count; ++i) {
+    find_escaping_locals(dec->func_statements[i]);
+  }
+  for (i = MAX_REG_ARGS; i < dec->func_arg_count; ++i) {
+    dec->func_args[i]->escapes = 1;
+  }
+  locals_size = 0;
+  for (var = local_variables; var; var = var->next) {
+    if (!var->escapes &&
+        (var->type->ty == TYPE_INT || var->type->ty == TYPE_CHAR ||
+         var->type->ty == TYPE_POINTER)) {
+      var->reg = new_vreg();
+    } else {
+      // the frame only has room for the ones left in memory
+      var->offset = locals_size;
+      locals_size = locals_size + var->size_on_stack;
+    }
+  }
+  variable_vreg_count = vreg_count;
+  for (i = 0; i < dec->func_arg_count && i < MAX_REG_ARGS; ++i) {
+    if (dec->func_args[i]->reg) {
+      ir = new_ir(IR_PARAM);
+      ir->dst = dec->func_args[i]->reg;
+      ir->imm = i;
+    }
+  }
+}
+
+void gen_global_variable(int name, type_t *type, constant_string_t *str,
+                         int value) {
+  global_variable_t *var = find_global_variable(name);
+  if (emit_ir) {
+    emit_str("global ");
+    emit_ident(name);
+    emit_char(' ');
+    emit_int(type->size);
+    emit_eol();
+    return;
+  }
+  if (!var->is_static) {
+    emit_symbol_directive(".globl", name);
+    emit_eol();
+  }
+  emit_directive(".section .sdata, \"aw\"");
+  emit_eol();
+  emit_symbol_directive(".type", name);
+  emit_str(", @object");
+  emit_eol();
+  emit_symbol_directive(".size", name);
+  emit_strn(", ", 2);
+  emit_int(type->size);
+  emit_eol();
+  emit_directive(".balign 8");
+  emit_eol();
+
+  emit_ident(name);
+  emit_char(':');
+  emit_eol();
+  if (str) {
+    emit_directive(".word .L.C");
+    emit_int(str->id);
+  } else if (value && type->size == 1) {
+    emit_directive(".byte ");
+    emit_int(value);
+  } else if (value) {
+    assert(type->size == 4);
+    emit_directive(".word ");
+    emit_int(value);
+  } else {
+    emit_directive(".zero ");
+    emit_int(type->size);
+  }
+  emit_eol();
+  if (!emit_compact) {
+    emit_eol();
   }
 }
 
-void print_func_epilogue(declaration_t *dec) {}
+// global constants whose address is taken, after all functions
+void gen_referenced_constants() {
+  global_variable_t *var;
+  for (var = global_variables; var; var = var->next) {
+    if (var->has_value && var->referenced) {
+      gen_global_variable(var->name, var->type, NULL, var->value);
+    }
+  }
+}
 
 void gen_declaration(declaration_t *dec) {
   size_t i;
+  global_variable_t *var;
   depth = 1;
   if (dec->declaration_type == DECLARATION_GLOBAL_VARIABLE) {
-    printf("  .globl  %.*s\n", dec->name->len, dec->name->str);
-    printf("  .section  .sdata, \"aw\"\n");
-    printf("  .type     %.*s, @object\n", dec->name->len, dec->name->str);
-    printf("  .size     %.*s, %zd\n", dec->name->len, dec->name->str,
-           calc_size_of_type(dec->type));
-
-    printf("  .balign    8\n");
-
-    printf("%.*s:\n", dec->name->len, dec->name->str);
-    if (dec->constant_string) {
-      printf("  .word .L.C%zd", dec->constant_string->id);
-    } else if (dec->constant_int) {
-      assert(calc_size_of_type(dec->type) == 4);
-      printf("  .word %d\n", dec->constant_int);
-    } else {
-      printf("  .zero %zd\n", calc_size_of_type(dec->type));
+    var = find_global_variable(dec->name);
+    if (!var->has_value) {
+      gen_global_variable(dec->name, dec->type, dec->constant_string,
+                          dec->constant_int);
     }
-    printf("\n\n");
   } else if (dec->declaration_type == DECLARATION_FUNCTION) {
-    update_indent();
-    print_func_prologue(dec);
+    insns = NULL;
+    insn_count = 0;
+    insn_capacity = 0;
+    vreg_count = 0;
+    current_function = dec;
+    inline_growth = 0;
+    reset_ir();
+    promote_locals(dec);
+    tail_block = NULL;
+    for (i = 0; i < dec->func_statement_count && !locals_size && !tail_block;
+         ++i) {
+      if (has_tail_recursion(dec->func_statements[i])) {
+        tail_block = new_block(".L.tail", gen_label_index(), "tail recursion");
+      }
+    }
+    if (tail_block) {
+      start_block(tail_block);
+    }
     for (i = 0; i < dec->func_statement_count; ++i) {
       gen(dec->func_statements[i]);
     }
-    print_func_epilogue(dec);
+    if (cur_block) {
+      ir_return(0);
+    }
+    verify_ir();
+    build_cfg();
+    choose_tracked_vregs();
+    verify_definitions();
+    compute_dominators();
+    construct_ssa();
+    verify_ssa();
+    eliminate_dead_code();
+    if (emit_ssa) {
+      print_ir_function(dec->name);
+    }
+    destruct_ssa();
+    if (emit_ssa) {
+      // printed above
+    } else if (emit_ir) {
+      print_ir_function(dec->name);
+    } else {
+      select_insns();
+      peephole(0);
+      allocate_registers();
+      peephole(1);
+      depth = 1;
+      update_indent();
+      print_func_prologue(dec);
+      print_insns();
+    }
+    keep_inline_body(dec);
     local_variables = NULL;
   } else if (dec->declaration_type == DECLARATION_TYPEDEF) {
     // do nothing
@@ -2263,46 +7067,204 @@ void gen_declaration(declaration_t *dec) {
   }
 }
 
+#define BENCH_ITERATIONS 10
+
 void print_header() {
-  printf("  .file	\"main.c\"\n");
-  printf("  .option nopic\n");
-  printf("  .align  4\n");
-  printf("\n");
+  emit_directive(".file \"main.c\"");
+  emit_eol();
+  emit_directive(".option nopic");
+  emit_eol();
+  emit_directive(".align 4");
+  emit_eol();
+  if (!emit_compact) {
+    emit_eol();
+  }
 }
 
 void print_constant_strings() {
   constant_string_t *cur = constant_string;
+  while (cur && emit_ir) {
+    emit_str("string ");
+    emit_int(cur->id);
+    emit_char(' ');
+    emit_strn(cur->str, cur->len);
+    emit_eol();
+    cur = cur->next;
+  }
   while (cur) {
-    printf("  .section .rodata\n");
-    printf("  .balign  4\n");
-    printf(".L.C%zd:\n", cur->id);
-    printf("  .string %.*s\n", cur->tok->len, cur->tok->str);
+    emit_directive(".section .rodata");
+    emit_eol();
+    emit_directive(".balign 4");
+    emit_eol();
+    emit_label(".L.C", cur->id, NULL);
+    emit_directive(".string ");
+    emit_strn(cur->str, cur->len);
+    emit_eol();
     cur = cur->next;
   }
+  constant_string = NULL;
+}
+
+// tokenize the whole input several times and report the throughput
+void bench_tokenize(char *src) {
+  int i;
+  size_t bytes = strlen(src);
+  timer_start();
+  for (i = 0; i < BENCH_ITERATIONS; ++i) {
+    init_lexer(src);
+    while (!token_count ||
+           tokens[token_slot(token_count - 1)].kind != TK_EOF) {
+      lex_token();
+    }
+  }
+  report_throughput("lex", bytes, BENCH_ITERATIONS);
+}
+
+// the source before the oldest token of the window is not looked at again
+#define SOURCE_RELEASE_CHUNK 1048576
+int source_released = 0;
+
+void release_consumed_source() {
+  token_t *oldest;
+  if (token_count <= TOKEN_WINDOW) {
+    return;
+  }
+  oldest = token_at(token_count - TOKEN_WINDOW);
+  if (oldest->offset - source_released < SOURCE_RELEASE_CHUNK) {
+    return;
+  }
+  release_input(source, oldest->offset);
+  source_released = oldest->offset;
+}
+
+// s is a comma separated list of "ast" and "gen"
+void parse_trace_option(char *s) {
+  while (*s) {
+    if (strncmp(s, "ast", 3) == 0) {
+      trace_ast = 1;
+    } else if (strncmp(s, "gen", 3) == 0) {
+      trace_gen = 1;
+    } else {
+      error("unknown trace kind: %s", s);
+    }
+    s = s + 3;
+    if (*s == ',') {
+      s = s + 1;
+    } else if (*s) {
+      error("unknown trace kind: %s", s - 3);
+    }
+  }
 }
 
 int main(int argc, char **argv) {
   declaration_t *dec;
+  char *path = NULL;
+  char *out_path = NULL;
+  char *src;
+  bool bench_lex = 0;
+  bool bench_compile = 0;
+  bool mem_report = 0;
+  bool fold_report = 0;
+  bool peephole_stats = 0;
+  int i;
 
-  if (argc >= 2) {
-    token = tokenize(read_file(argv[1]));
-  } else {
-    token = tokenize(read_file(NULL));
+  for (i = 1; i < argc; ++i) {
+    if (strcmp(argv[i], "--bench=lex") == 0) {
+      bench_lex = 1;
+    } else if (strcmp(argv[i], "--bench=compile") == 0) {
+      bench_compile = 1;
+    } else if (strncmp(argv[i], "--trace=", 8) == 0) {
+      parse_trace_option(argv[i] + 8);
+    } else if (strcmp(argv[i], "--mem-report") == 0) {
+      mem_report = 1;
+    } else if (strcmp(argv[i], "--fold-report") == 0) {
+      fold_report = 1;
+    } else if (strcmp(argv[i], "--peephole-stats") == 0) {
+      peephole_stats = 1;
+    } else if (strcmp(argv[i], "--inline-remarks") == 0) {
+      inline_remarks = 1;
+    } else if (strcmp(argv[i], "--march=rv32i") == 0) {
+      target_has_m = 0;
+    } else if (strcmp(argv[i], "--march=rv32im") == 0) {
+      target_has_m = 1;
+    } else if (strcmp(argv[i], "--compact") == 0) {
+      emit_compact = 1;
+    } else if (strcmp(argv[i], "--emit-ir") == 0) {
+      emit_ir = 1;
+    } else if (strcmp(argv[i], "--emit-ssa") == 0) {
+      emit_ir = 1;
+      emit_ssa = 1;
+    } else if (strcmp(argv[i], "-o") == 0) {
+      ++i;
+      if (i == argc) {
+        error("-o needs a file name");
+      }
+      out_path = argv[i];
+    } else if (argv[i][0] == '-') {
+      error("unknown option: %s", argv[i]);
+    } else if (path) {
+      error("more than one input file: %s", argv[i]);
+    } else {
+      path = argv[i];
+    }
+  }
+
+  init_arenas();
+  if (bench_lex) {
+    bench_tokenize(read_file(path));
+    return 0;
+  }
+
+  src = read_file(path);
+  if (bench_compile) {
+    timer_start();
   }
+  init_lexer(src);
 
   if (at_eof()) {
     error("no input");
   }
 
-  print_header();
+  init_types();
+  init_emitter();
+  init_allocator();
+  init_ir();
+  init_tiles();
+  init_peephole();
+  init_bitsets();
+  open_output(out_path);
+  if (!emit_ir) {
+    print_header();
+  }
   while (!at_eof()) {
     dec = parse_declaration();
     if (dec) {
-      print_declaration(dec);
+      if (trace_ast) {
+        print_declaration(dec);
+      }
       gen_declaration(dec);
     }
+    print_constant_strings();
+    arena_reset(function_arena);
+    release_consumed_source();
+  }
+  gen_referenced_constants();
+  emit_flush();
+  close_output();
+
+  if (bench_compile) {
+    report_throughput("compile", lex_pos, 1);
+  }
+  if (mem_report) {
+    print_arena_report(program_arena);
+    print_arena_report(function_arena);
+  }
+  if (fold_report) {
+    print_fold_report(path);
+  }
+  if (peephole_stats) {
+    print_peephole_stats(path);
   }
-  print_constant_strings();
 
   return 0;
 }
\ No newline at end of file
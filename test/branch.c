@@ -0,0 +1,69 @@
+int values[5];
+
+// every comparison in branch context, against another register and zero
+int branches(int a, int b) {
+  int bits = 0;
+  if (a < b) {
+    bits = bits + 1;
+  }
+  if (a <= b) {
+    bits = bits + 2;
+  }
+  if (a > b) {
+    bits = bits + 4;
+  }
+  if (a >= b) {
+    bits = bits + 8;
+  }
+  if (a == b) {
+    bits = bits + 16;
+  }
+  if (a != b) {
+    bits = bits + 32;
+  }
+  if (a < 0) {
+    bits = bits + 64;
+  }
+  if (!(a <= 0)) {
+    bits = bits + 128;
+  }
+  if (a == 0 || !b) {
+    bits = bits + 256;
+  }
+  if (!(a != 0 && b >= a)) {
+    bits = bits + 512;
+  }
+  return bits;
+}
+
+// the same comparisons as values
+int values_of(int a, int b) {
+  return (a < b) + (a <= b) * 2 + (a > b) * 4 + (a >= b) * 8 +
+         (a == b) * 16 + (a != b) * 32 + (a < 0) * 64 + !(a <= 0) * 128 +
+         (a == 0 || !b) * 256 + !(a != 0 && b >= a) * 512;
+}
+
+int main() {
+  int i;
+  int j;
+  int n = 0;
+  values[0] = -2147483647 - 1;
+  values[1] = -1;
+  values[2] = 0;
+  values[3] = 1;
+  values[4] = 2147483647;
+  for (i = 0; i < 5; i = i + 1) {
+    for (j = 0; j < 5; j = j + 1) {
+      printf("%d %d %d\n", values[i], values[j],
+             branches(values[i], values[j]));
+      if (branches(values[i], values[j]) != values_of(values[i], values[j])) {
+        printf("mismatch\n");
+      }
+    }
+  }
+  while (n < 10 && !(n == 7)) {
+    n = n + 1;
+  }
+  printf("%d\n", n);
+  return 0;
+}
@@ -1,6 +1,7 @@
 const int A = 100;
 const int B = 200;
 const int C = 300;
+const char G = 300;  // out of range for char
 
 void putint(int x) {
   if (x >= 10) {
@@ -14,6 +15,8 @@ int main() {
   const int D = 400;
   const int E = 500;
   const int F = 600;
+  const int *p = &B;
+  const char *q = &G;
   putint(A);
   putchar('\n');
   putint(B);
@@ -26,5 +29,11 @@ int main() {
   putchar('\n');
   putint(F);
   putchar('\n');
+  putint(*p + A * C);
+  putchar('\n');
+  putint(G);
+  putchar('\n');
+  putint(*q + G);
+  putchar('\n');
   return 0;
 }
\ No newline at end of file
@@ -0,0 +1,56 @@
+int calls = 0;
+
+int count(int x) {
+  calls = calls + 1;
+  return x;
+}
+
+int main() {
+  int x = 7;
+  int i = 0;
+  int n = 0;
+
+  printf("%d %d %d\n", 4 * 8 + 1, (2 - 5) * 3 / 2, -7 % 3);
+  printf("%d %d %d\n", 6 & 3, 6 | 3, 6 ^ 3);
+  printf("%d %d %d %d\n", 1 < 2, 2 <= 1, 3 == 3, 3 != 3);
+  printf("%d %d %d\n", 2 && 3, 0 || 0, !5);
+  printf("%d %d\n", sizeof(int) * 4 + sizeof(char), -(-x));
+  printf("%d %d %d %d\n", x + 0, 0 + x, x - 0, 0 - x);
+  printf("%d %d %d %d\n", x * 1, 1 * x, x / 1, x % 1);
+  printf("%d %d %d\n", x & -1, x | 0, x ^ 0);
+
+  // the constant operand decides, but the other one has to run
+  printf("%d %d %d\n", count(x) * 0, 0 & count(x), count(x) | -1);
+  printf("%d %d\n", count(x) && 0, !(count(x) || 1));
+  printf("%d %d %d\n", 1 && count(x), 0 || count(0), count(x) && 3);
+  printf("%d %d\n", 0 && count(x), 1 || count(x));
+  printf("calls %d\n", calls);
+
+  if (0) {
+    printf("not reached\n");
+  }
+  if (1) {
+    printf("then\n");
+  } else {
+    printf("not reached\n");
+  }
+  if (2 - 2) {
+    printf("not reached\n");
+  } else {
+    printf("else\n");
+  }
+  while (0) {
+    printf("not reached\n");
+  }
+  for (i = 5; 0; i = i + 1) {
+    printf("not reached\n");
+  }
+  while (1) {
+    n = n + 1;
+    if (n == 3) {
+      break;
+    }
+  }
+  printf("%d %d\n", i, n);
+  return 0;
+}
@@ -0,0 +1,23 @@
+int sum10(int a, int b, int c, int d, int e, int f, int g, int h, int i,
+          int j) {
+  return a + 2 * b + 3 * c + 4 * d + 5 * e + 6 * f + 7 * g + 8 * h + 9 * i +
+         10 * j;
+}
+
+int pick(int a, int b, int c, int d, int e, int f, int g, int h, int i) {
+  return i - a;
+}
+
+int g = 5;
+
+int main() {
+  int x = 3;
+  int y = 4;
+  printf("%d\n", sum10(1, 2, 3, 4, 5, 6, 7, 8, 9, 10));
+  printf("%d\n", pick(1, 2, 3, 4, 5, 6, 7, 8, pick(0, 0, 0, 0, 0, 0, 0, 0, 42)));
+  printf("%d %d %d %d %d %d %d %d %d %d\n", 1, 2, 3, 4, 5, 6, 7, 8, 9, 10);
+  // constants, registers, trees and call results mixed in one call
+  printf("%d\n", sum10(x * y + 1, pick(0, 0, 0, 0, 0, 0, 0, 0, y), 7, x, g,
+                       x - y, &g == &g, y * y - x, g + x, 11));
+  return 0;
+}
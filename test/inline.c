@@ -0,0 +1,68 @@
+int calls = 0;
+int visited[8];
+
+int twice(int x) { return x + x; }
+
+static int count(int x) {
+  calls = calls + 1;
+  return x;
+}
+
+// several returns, and falling off the end
+static inline int classify(int x) {
+  if (x < 0) {
+    return -1;
+  }
+  if (x == 0) {
+    return 0;
+  }
+  return 1;
+}
+
+static inline char low_byte(char c) { return c; }
+
+static inline void bump(int n) { calls = calls + n; }
+
+// calls of expanded functions are expanded in turn
+static inline int quad(int x) { return twice(twice(x)); }
+
+// recursion stays a call
+int dfs(int node) {
+  if (8 <= node || visited[node]) {
+    return 0;
+  }
+  visited[node] = 1;
+  return 1 + dfs(node * 2) + dfs(node * 2 + 1);
+}
+
+int is_odd(int n);
+
+static inline int is_even(int n) {
+  if (n == 0) {
+    return 1;
+  }
+  return is_odd(n - 1);
+}
+
+int is_odd(int n) {
+  if (n == 0) {
+    return 0;
+  }
+  return is_even(n - 1);
+}
+
+int main() {
+  int i;
+  int sum = 0;
+  for (i = -2; i <= 2; i = i + 1) {
+    sum = sum + classify(i) * 10 + twice(i);
+  }
+  printf("%d\n", sum);
+  printf("%d %d\n", low_byte(300), low_byte(-129));
+  bump(5);
+  printf("%d %d\n", count(twice(3)) + count(4), calls);
+  printf("%d %d\n", quad(5), quad(count(1)));
+  printf("%d\n", dfs(1));
+  printf("%d %d %d\n", is_even(10), is_odd(7), is_even(7));
+  return 0;
+}
@@ -0,0 +1,73 @@
+struct record {
+  char tag;
+  char flag;
+  int value;
+  int pad[600];
+  char far_tag;
+  int far_value;
+};
+
+struct record global_record;
+
+// char members load as bytes, far members past the 12-bit displacement
+int sum_record(struct record *r) {
+  return r->tag + r->flag * 10 + r->value * 100 + r->far_tag * 1000 +
+         r->far_value * 10000;
+}
+
+void putint(int n) {
+  printf("%d ", n);
+}
+
+// immediates at the edges of what fits 12 bits
+void immediates(int x) {
+  putint(x + 2047);
+  putint(x + 2048);
+  putint(x - 2048);
+  putint(x - 2049);
+  putint(x & 2047);
+  putint(x & -2048);
+  putint(x | 4095);
+  putint(x ^ -1);
+  putint(x < -2048);
+  putint(x < 2047);
+  putint(x <= 2046);
+  putint(x <= 2047);
+  putint(x > -2049);
+  putint(x > 2046);
+  putint(x >= -2048);
+  putint(x >= 2048);
+  putint(x == 2047);
+  putint(x != -2048);
+}
+
+int main() {
+  struct record local;
+  struct record *p = &local;
+  char c;
+  int i;
+
+  local.tag = 200;
+  local.flag = -3;
+  local.value = 7;
+  local.far_tag = 127;
+  local.far_value = -5;
+  p->pad[599] = 9;
+  printf("%d %d %d %d\n", local.tag, p->flag, p->pad[599], sum_record(p));
+
+  global_record.tag = 'a';
+  global_record.flag = 1000;
+  global_record.far_tag = -128;
+  global_record.far_value = 3;
+  printf("%d %d\n", global_record.flag, sum_record(&global_record));
+
+  c = local.tag;
+  local.flag = c + 1;
+  printf("%d %d\n", c, local.flag);
+
+  for (i = 0; i < 6; i = i + 1) {
+    immediates(i * 1023 - 2049);
+    printf("\n");
+  }
+  return 0;
+}
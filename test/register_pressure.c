@@ -0,0 +1,25 @@
+int id(int x) { return x; }
+
+int sum4(int a, int b, int c, int d) { return a + b + c + d; }
+
+// every left operand stays live while the right one is evaluated
+int deep(int x) {
+  return x + (x * 2 + (x * 3 + (x * 4 + (x * 5 + (x * 6 + (x * 7 + (x * 8 +
+         (x * 9 + (x * 10 + (x * 11 + (x * 12 + (x * 13 + (x * 14 +
+         (x * 15 + (x * 16 + (x * 17 + (x * 18 + (x * 19 + x * 20))))))))))))))))));
+}
+
+// values live across calls
+int across(int x) {
+  return id(x) + id(x + 1) * (id(x + 2) - sum4(id(1), id(2), x, id(x) * 2));
+}
+
+int main() {
+  int i;
+  int total = 0;
+  for (i = 0; i < 10; i = i + 1) {
+    total = total + deep(i) - across(i);
+  }
+  printf("%d %d %d\n", deep(3), across(5), total);
+  return 0;
+}
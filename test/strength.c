@@ -0,0 +1,78 @@
+int values[12];
+
+struct point {
+  int x;
+  int y;
+  int z;
+};
+
+// divisors with a multiply-high, and factors with shifts and adds
+void odd(int x) {
+  printf("%d %d %d\n", x * 3, x / 3, x % 3);
+  printf("%d %d %d\n", x * 7, x / 7, x % 7);
+  printf("%d %d %d\n", x * 10, x / 10, x % 10);
+  printf("%d %d %d\n", x * 12, x / 12, x % 12);
+  printf("%d %d %d\n", x * 100, x / 100, x % 100);
+  printf("%d %d %d\n", x * 641, x / 641, x % 641);
+  printf("%d %d %d\n", x * 1000, x / 1000, x % 1000);
+  printf("%d %d %d\n", x * 65535, x / 65535, x % 65535);
+  printf("%d %d %d\n", x * 1431655765, x / 1431655765, x % 1431655765);
+  printf("%d %d %d\n", x * 2147483647, x / 2147483647, x % 2147483647);
+  printf("%d %d %d\n", x * -3, x / -3, x % -3);
+  printf("%d %d %d\n", x * -10, x / -10, x % -10);
+  printf("%d %d %d\n", x * -641, x / -641, x % -641);
+}
+
+// powers of two, which are shifts and masks
+void even(int x) {
+  printf("%d %d %d\n", x * 2, x / 2, x % 2);
+  printf("%d %d %d\n", x * 16, x / 16, x % 16);
+  printf("%d %d %d\n", x * 4096, x / 4096, x % 4096);
+  printf("%d %d %d\n", x * 65536, x / 65536, x % 65536);
+  printf("%d %d %d\n", x * 1073741824, x / 1073741824, x % 1073741824);
+  printf("%d %d %d\n", x * -2, x / -2, x % -2);
+  printf("%d %d %d\n", x * -16, x / -16, x % -16);
+  printf("%d %d %d\n", x * -65536, x / -65536, x % -65536);
+  printf("%d %d\n", x * (-2147483647 - 1), x / 1, x * -1);
+}
+
+// no constant at all, which without the M extension is a call
+void variable(int x, int y) {
+  if (y != 0 && !(y == -1 && x == -2147483647 - 1)) {
+    printf("%d %d %d\n", x * y, x / y, x % y);
+  }
+}
+
+int main() {
+  int i;
+  int j;
+  int sum = 0;
+  struct point points[5];
+  values[0] = -2147483647 - 1;
+  values[1] = -2147483647;
+  values[2] = -1000001;
+  values[3] = -641;
+  values[4] = -7;
+  values[5] = -1;
+  values[6] = 0;
+  values[7] = 1;
+  values[8] = 99;
+  values[9] = 65536;
+  values[10] = 1000001;
+  values[11] = 2147483647;
+  for (i = 0; i < 12; i = i + 1) {
+    printf("%d\n", values[i]);
+    odd(values[i]);
+    even(values[i]);
+    for (j = 0; j < 12; j = j + 1) {
+      variable(values[i], values[j]);
+    }
+  }
+  // the constant factor on the left, and a 12-byte element size
+  for (i = 0; i < 5; i = i + 1) {
+    points[i].y = 10 * i;
+    sum = sum + points[i].y;
+  }
+  printf("%d\n", sum);
+  return 0;
+}
@@ -0,0 +1,76 @@
+int total = 0;
+
+// tail recursion becomes a loop. the depths below would overflow the
+// stack if every call kept a frame
+int sum_to(int n, int acc) {
+  if (n == 0) {
+    return acc;
+  }
+  return sum_to(n - 1, acc + n % 10);
+}
+
+// the parameters trade places
+int count_swaps(int a, int b, int n) {
+  if (n == 0) {
+    return a * 10 + b;
+  }
+  return count_swaps(b, a, n - 1);
+}
+
+int is_odd(int n);
+
+// calls in tail position jump to the callee
+int is_even(int n) {
+  if (n == 0) {
+    return 1;
+  }
+  return is_odd(n - 1);
+}
+
+int is_odd(int n) {
+  if (n == 0) {
+    return 0;
+  }
+  return is_even(n - 1);
+}
+
+void add(int n) { total = total + n; }
+
+// a final call in a void function
+void add_all(int n) {
+  if (n == 0) {
+    return;
+  }
+  add(n % 10);
+  add_all(n - 1);
+}
+
+int show(int x) { return printf("%d\n", x); }
+
+char wrap(char c, int n) {
+  if (n == 0) {
+    return c;
+  }
+  return wrap(c + 100, n - 1);
+}
+
+// an argument may point to a local, so the call keeps its frame
+int depth_of(int *parent, int n) {
+  int here = *parent + 1;
+  if (n == 0) {
+    return here;
+  }
+  return depth_of(&here, n - 1);
+}
+
+int main() {
+  printf("%d\n", sum_to(10000000, 0));
+  printf("%d %d\n", count_swaps(1, 2, 7), count_swaps(1, 2, 8));
+  printf("%d %d\n", is_even(10000001), is_odd(10000001));
+  add_all(10000000);
+  printf("%d\n", total);
+  printf("%d\n", show(42));
+  printf("%d\n", wrap(1, 5));
+  printf("%d\n", depth_of(&total, 10));
+  return 0;
+}
@@ -1,7 +1,20 @@
 #include <errno.h>
+#include <fcntl.h>
 #include <stdarg.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+// files are memory-mapped where the system supports it. newlib targets such
+// as riscv32-unknown-elf do not, and read every input like a pipe
+#if defined(_POSIX_MAPPED_FILES) && _POSIX_MAPPED_FILES > 0
+#define HAVE_MMAP 1
+#include <sys/mman.h>
+#endif
 
 void error(char *fmt, ...) {
   va_list ap;
@@ -17,25 +30,122 @@ void eprintf(char *fmt, ...) {
   vfprintf(stderr, fmt, ap);
 }
 
+#ifdef HAVE_MMAP
+// regular files are mapped read-only. the mapping is followed by at least
+// one anonymous zero page, so the contents are always '\0' terminated
+// without writing to the file mapping.
+static char *map_file(int fd, size_t size, char *path) {
+  size_t page = sysconf(_SC_PAGESIZE);
+  size_t len = (size / page + 2) * page;
+  char *buf = mmap(NULL, len, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (buf == MAP_FAILED) error("%s: mmap: %s", path, strerror(errno));
+  if (size > 0 && mmap(buf, size, PROT_READ, MAP_PRIVATE | MAP_FIXED, fd,
+                       0) == MAP_FAILED)
+    error("%s: mmap: %s", path, strerror(errno));
+  return buf;
+}
+#endif
+
+// pipes and terminals, and files where there is no mmap, are read in chunks
+// into a doubling buffer
+static char *read_stream(int fd, char *path) {
+  size_t cap = 64 * 1024;
+  size_t len = 0;
+  char *buf = malloc(cap);
+  for (;;) {
+    // keep two bytes for the terminator and the tokenizer's lookahead
+    if (len + 2 == cap) {
+      cap = cap * 2;
+      buf = realloc(buf, cap);
+    }
+    if (!buf) error("%s: out of memory", path);
+    ssize_t n = read(fd, buf + len, cap - len - 2);
+    if (n < 0 && errno == EINTR) continue;
+    if (n < 0) error("%s: read: %s", path, strerror(errno));
+    if (n == 0) break;
+    len += n;
+  }
+  buf[len] = '\0';
+  buf[len + 1] = '\0';
+  return buf;
+}
+
+// returns the whole contents of `path` (stdin if NULL), '\0' terminated
 char *read_file(char *path) {
-  FILE *fp = path ? fopen(path, "r") : stdin;
-  size_t size = 128 * 1024 - 2;
-  if (!fp) error("cannot open %s: %s", path, strerror(errno));
-
-  // check file size
-  // if (fseek(fp, 0, SEEK_END) == -1)
-  //   error("%s: fseek: %s", path, strerror(errno));
-  // size_t size = ftell(fp);
-  // if (fseek(fp, 0, SEEK_SET) == -1)
-  //   error("%s: fseek: %s", path, strerror(errno));
-
-  // read file
-  char *buf = calloc(1, size + 2);
-  fread(buf, size, 1, fp);
-
-  // "\n\0" is added to the end of the file
-  if (size == 0 || buf[size - 1] != '\n') buf[size++] = '\n';
-  buf[size] = '\0';
-  fclose(fp);
+  int fd = path ? open(path, O_RDONLY) : STDIN_FILENO;
+  char *buf;
+  if (fd < 0) error("cannot open %s: %s", path, strerror(errno));
+  if (!path) path = "<stdin>";
+
+#ifdef HAVE_MMAP
+  struct stat st;
+  if (fstat(fd, &st) < 0) error("%s: fstat: %s", path, strerror(errno));
+  if (S_ISREG(st.st_mode)) {
+    buf = map_file(fd, st.st_size, path);
+  } else {
+    buf = read_stream(fd, path);
+  }
+#else
+  buf = read_stream(fd, path);
+#endif
+  if (fd != STDIN_FILENO) close(fd);
   return buf;
 }
+
+// buf[0..len) of a read_file() result will not be read again: hand the
+// whole pages in it back to the kernel. without mmap the buffer is kept
+void release_input(char *buf, int len) {
+#ifdef HAVE_MMAP
+  size_t page = sysconf(_SC_PAGESIZE);
+  uintptr_t begin = ((uintptr_t)buf + page - 1) / page * page;
+  uintptr_t end = ((uintptr_t)buf + len) / page * page;
+  if (begin < end) madvise((void *)begin, end - begin, MADV_DONTNEED);
+#endif
+}
+
+static int output_fd = STDOUT_FILENO;
+
+// assembly goes to stdout unless a path is given
+void open_output(char *path) {
+  if (!path) return;
+  output_fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (output_fd < 0) error("cannot open %s: %s", path, strerror(errno));
+}
+
+void write_output(char *buf, int len) {
+  while (len > 0) {
+    ssize_t n = write(output_fd, buf, len);
+    if (n < 0 && errno == EINTR) continue;
+    if (n < 0) error("write: %s", strerror(errno));
+    buf += n;
+    len -= n;
+  }
+}
+
+void close_output() {
+  if (output_fd != STDOUT_FILENO && close(output_fd) < 0)
+    error("close: %s", strerror(errno));
+}
+
+// wall-clock seconds, or processor time where there is no monotonic clock
+static double now_seconds() {
+#if defined(_POSIX_TIMERS) && _POSIX_TIMERS > 0
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec + now.tv_nsec / 1e9;
+#else
+  return (double)clock() / CLOCKS_PER_SEC;
+#endif
+}
+
+static double timer_begin;
+
+void timer_start() { timer_begin = now_seconds(); }
+
+// prints "<label>: <MB/s>" for `iterations` passes over `bytes` bytes
+void report_throughput(char *label, size_t bytes, int iterations) {
+  double sec = now_seconds() - timer_begin;
+  double mb = (double)bytes * iterations / (1024 * 1024);
+  eprintf("%s: %zu bytes x %d in %.3f s, %.1f MB/s\n", label, bytes,
+          iterations, sec, mb / sec);
+}
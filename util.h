@@ -4,4 +4,16 @@ void error(char *fmt, ...);
 
 void eprintf(char *fmt, ...);
 
-char *read_file(char *path);
\ No newline at end of file
+char *read_file(char *path);
+
+void release_input(char *buf, int len);
+
+void open_output(char *path);
+
+void write_output(char *buf, int len);
+
+void close_output();
+
+void timer_start();
+
+void report_throughput(char *label, size_t bytes, int iterations);
\ No newline at end of file